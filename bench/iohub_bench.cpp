@@ -0,0 +1,387 @@
+// File:     bench/iohub_bench.cpp
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Backend scaling benchmark.
+// For every backend, fd kind, fd count, active fraction and churn rate
+// it registers the fds and measures the wall and CPU time of wait() and
+// per event. Results are printed as JSON. Two modes:
+//   poll   the active fds stay readable, wait() never blocks
+//   block  another thread makes one active fd readable at a time, wait()
+//          blocks until then; adds the wakeup and blocking syscall cost
+//
+// usage: iohub_bench [--backends select,poll,epoll,io_uring,adaptive]
+//     [--kinds eventfd,pipe,socketpair] [--fds 10,100,...,1000000]
+//     [--active 0.01,0.1,1] [--churn 0,16] [--modes poll,block]
+//     [--time-ms 200] [--out file]
+
+// C
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// C++
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Linux
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/utsname.h>
+
+// iohub
+#include "AdaptivePoller.h"
+#include "Epoll.h"
+#include "IoUring.h"
+#include "Poll.h"
+#include "Select.h"
+
+namespace {
+
+using namespace iohub;
+
+struct Options {
+    std::vector<std::string> backends{"select", "poll", "epoll",
+        "io_uring", "adaptive"};
+    std::vector<std::string> kinds{"eventfd"};
+    std::vector<size_t> fds{10, 100, 1000, 10000, 100000, 1000000};
+    std::vector<double> active{0.01, 0.1, 1.0};
+    std::vector<size_t> churn{0, 16};
+    std::vector<std::string> modes{"poll", "block"};
+    int time_ms = 200;
+    const char* out = nullptr;
+}; // command line
+
+struct Result {
+    std::string backend, kind, mode;
+    size_t fds;
+    double active;
+    size_t churn;
+    bool skipped;
+    uint64_t waits, events, wall_ns, cpu_ns;
+}; // one configuration
+
+std::vector<std::string> split(const char* arg) {
+    std::vector<std::string> list;
+    std::string item;
+    for (const char* p = arg; ; ++p) {
+        if (*p == ',' || !*p) {
+            if (!item.empty()) list.push_back(item);
+            item.clear();
+            if (!*p) break;
+        } else {
+            item += *p;
+        }
+    }
+    return list;
+}
+
+std::unique_ptr<PollerBase> create(const std::string& name) {
+    if (name == "select") return std::unique_ptr<PollerBase>(new Select);
+    if (name == "poll") return std::unique_ptr<PollerBase>(new Poll);
+    if (name == "epoll") return std::unique_ptr<PollerBase>(new Epoll);
+    if (name == "io_uring") return std::unique_ptr<PollerBase>(new IoUring);
+    if (name == "adaptive")
+        return std::unique_ptr<PollerBase>(new AdaptivePoller);
+    return nullptr;
+}
+
+uint64_t cpu_ns() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000ULL
+        + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000ULL;
+}
+
+uint64_t wall_ns() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(
+        steady_clock::now().time_since_epoch()).count();
+}
+
+// watched read ends and the fds to make them readable
+struct FdSet {
+    std::vector<int> read_arr, write_arr, all_arr;
+
+    ~FdSet() {
+        for (int fd : all_arr) ::close(fd);
+    }
+
+    bool open(const std::string& kind, size_t count) {
+        read_arr.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            int pair[2] = {-1, -1};
+            if (kind == "eventfd") {
+                pair[0] = pair[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (pair[0] == -1) return false;
+                all_arr.push_back(pair[0]);
+            } else {
+                int ret = kind == "pipe" ? pipe(pair)
+                    : socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+                if (ret == -1) return false;
+                all_arr.push_back(pair[0]);
+                all_arr.push_back(pair[1]);
+            }
+            read_arr.push_back(pair[0]);
+            write_arr.push_back(pair[1]);
+        }
+        return true;
+    }
+
+    void activate(size_t index) {
+        uint64_t one = 1;
+        ssize_t ret = ::write(write_arr[index], &one, sizeof(one));
+        (void)ret;
+    }
+
+    static void drain(int fd) {
+        uint64_t value = 0;
+        ssize_t ret = ::read(fd, &value, sizeof(value));
+        (void)ret;
+    }
+}; // struct FdSet
+
+Result run(const Options& opt, const std::string& backend,
+        const std::string& kind, const std::string& mode, size_t fds,
+        double active, size_t churn) {
+    Result result{backend, kind, mode, fds, active, churn,
+        true, 0, 0, 0, 0};
+    std::unique_ptr<PollerBase> poller = create(backend);
+    FdSet fd_set;
+    if (!poller || !fd_set.open(kind, fds)) return result;
+
+    // the first active fds stay readable, the churn hits the idle ones
+    size_t active_count = std::max<size_t>(1,
+        static_cast<size_t>(fds * active));
+    active_count = std::min(active_count, fds);
+    for (size_t i = 0; i < fds; ++i)
+        poller->insert(fd_set.read_arr[i], IOHUB_IN);
+
+    std::mt19937 rng(42);
+    size_t idle = fds - active_count;
+    uint64_t events = 0;
+    auto churn_once = [&] {
+        for (size_t i = 0; i < churn && idle; ++i) {
+            int fd = fd_set.read_arr[active_count + rng() % idle];
+            poller->erase(fd);
+            poller->insert(fd, IOHUB_IN);
+        }
+    };
+    uint64_t wall_start = 0, cpu_start = 0;
+
+    if (mode == "block") {
+        // one fd readable at a time, the next after the wait returned
+        std::atomic<uint64_t> acked(0);
+        std::atomic<bool> done(false);
+        std::thread waker([&fd_set, &acked, &done, active_count] {
+            std::mt19937 waker_rng(7);
+            for (uint64_t sent = 0; !done.load(); ++sent) {
+                fd_set.activate(waker_rng() % active_count);
+                while (acked.load() <= sent && !done.load())
+                    std::this_thread::yield();
+            }
+        });
+        auto drain = [&events](int fd, int) {
+            FdSet::drain(fd);
+            ++events;
+        };
+        wall_start = wall_ns();
+        cpu_start = cpu_ns();
+        uint64_t deadline = wall_start + opt.time_ms * 1000000ULL;
+        do {
+            churn_once();
+            poller->visit(drain, 100);
+            ++result.waits;
+            acked.store(events);
+        } while (wall_ns() < deadline);
+        result.wall_ns = wall_ns() - wall_start;
+        result.cpu_ns = cpu_ns() - cpu_start;
+        done.store(true);
+        waker.join();
+    } else {
+        // the active fds stay readable
+        for (size_t i = 0; i < active_count; ++i) fd_set.activate(i);
+        auto count = [&events](int, int) { ++events; };
+
+        // warm up, then measure until the time budget is spent
+        poller->visit(count, 0);
+        events = 0;
+        wall_start = wall_ns();
+        cpu_start = cpu_ns();
+        uint64_t deadline = wall_start + opt.time_ms * 1000000ULL;
+        do {
+            churn_once();
+            poller->visit(count, 0);
+            ++result.waits;
+        } while (wall_ns() < deadline);
+        result.wall_ns = wall_ns() - wall_start;
+        result.cpu_ns = cpu_ns() - cpu_start;
+    }
+    result.events = events;
+    result.skipped = false;
+    return result;
+}
+
+void raise_fd_limit() {
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+void print(FILE* out, const std::vector<Result>& result_arr) {
+    utsname name{};
+    uname(&name);
+    std::fprintf(out, "{\n  \"kernel\": \"%s\",\n  \"results\": [\n",
+        name.release);
+    for (size_t i = 0; i < result_arr.size(); ++i) {
+        const Result& r = result_arr[i];
+        std::fprintf(out, "    {\"backend\": \"%s\", \"kind\": \"%s\", "
+            "\"mode\": \"%s\", \"fds\": %zu, \"active\": %g, "
+            "\"churn\": %zu, ", r.backend.c_str(), r.kind.c_str(),
+            r.mode.c_str(), r.fds, r.active, r.churn);
+        if (r.skipped) {
+            std::fprintf(out, "\"skipped\": true}");
+        } else {
+            double waits = r.waits ? r.waits : 1;
+            double events = r.events ? r.events : 1;
+            std::fprintf(out, "\"waits\": %llu, \"events\": %llu, "
+                "\"wall_ns\": %llu, \"cpu_ns\": %llu, "
+                "\"ns_per_wait\": %.1f, \"ns_per_event\": %.1f, "
+                "\"cpu_ns_per_event\": %.1f, \"events_per_sec\": %.0f}",
+                (unsigned long long)r.waits, (unsigned long long)r.events,
+                (unsigned long long)r.wall_ns, (unsigned long long)r.cpu_ns,
+                r.wall_ns / waits, r.wall_ns / events, r.cpu_ns / events,
+                r.events * 1e9 / (r.wall_ns ? r.wall_ns : 1));
+        }
+        std::fprintf(out, i + 1 < result_arr.size() ? ",\n" : "\n");
+    }
+
+    // knee: past the fd count with the lowest cost per event, the first
+    // one costing twice as much, for each backend, kind, mode, active
+    // and churn
+    std::fprintf(out, "  ],\n  \"knees\": [\n");
+    auto same = [](const Result& a, const Result& b) {
+        return !b.skipped && a.backend == b.backend && a.kind == b.kind
+            && a.mode == b.mode && a.active == b.active
+            && a.churn == b.churn;
+    };
+    auto cost = [](const Result& r) {
+        return double(r.wall_ns) / (r.events ? r.events : 1);
+    };
+    bool first = true;
+    for (size_t i = 0; i < result_arr.size(); ++i) {
+        const Result& r = result_arr[i];
+        if (r.skipped) continue;
+        bool leader = true;
+        const Result* best = &r;
+        for (size_t j = 0; j < result_arr.size(); ++j) {
+            if (!same(r, result_arr[j])) continue;
+            if (j < i) leader = false;
+            if (cost(result_arr[j]) < cost(*best)) best = &result_arr[j];
+        }
+        if (!leader) continue;
+        size_t knee = 0;
+        for (const Result& s : result_arr) {
+            if (same(r, s) && s.fds > best->fds && cost(s) > 2 * cost(*best)
+                    && (!knee || s.fds < knee)) knee = s.fds;
+        }
+        std::fprintf(out, "%s    {\"backend\": \"%s\", \"kind\": \"%s\", "
+            "\"mode\": \"%s\", \"active\": %g, \"churn\": %zu, "
+            "\"best_fds\": %zu, \"knee_fds\": %zu}", first ? "" : ",\n",
+            r.backend.c_str(), r.kind.c_str(), r.mode.c_str(), r.active,
+            r.churn, best->fds, knee);
+        first = false;
+    }
+    std::fprintf(out, "\n  ]\n}\n");
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i];
+        const char* value = argv[i + 1];
+        if (key == "--backends") opt.backends = split(value);
+        else if (key == "--kinds") opt.kinds = split(value);
+        else if (key == "--modes") opt.modes = split(value);
+        else if (key == "--time-ms") opt.time_ms = std::atoi(value);
+        else if (key == "--out") opt.out = value;
+        else if (key == "--fds" || key == "--active" || key == "--churn") {
+            std::vector<std::string> list = split(value);
+            if (key == "--fds") opt.fds.clear();
+            if (key == "--active") opt.active.clear();
+            if (key == "--churn") opt.churn.clear();
+            for (const std::string& item : list) {
+                if (key == "--fds") opt.fds.push_back(std::stoul(item));
+                if (key == "--active") opt.active.push_back(std::stod(item));
+                if (key == "--churn") opt.churn.push_back(std::stoul(item));
+            }
+        } else {
+            std::fprintf(stderr, "unknown option %s\n", key.c_str());
+            return 1;
+        }
+    }
+
+    raise_fd_limit();
+    std::vector<Result> result_arr;
+    for (const std::string& backend : opt.backends)
+    for (const std::string& kind : opt.kinds)
+    for (const std::string& mode : opt.modes)
+    for (double active : opt.active)
+    for (size_t churn : opt.churn)
+    for (size_t fds : opt.fds) {
+        try {
+            result_arr.push_back(run(opt, backend, kind, mode,
+                fds, active, churn));
+        } catch (const IOHubExcept& e) {
+            // e.g. io_uring is not available
+            result_arr.push_back({backend, kind, mode, fds, active,
+                churn, true, 0, 0, 0, 0});
+        }
+        std::fprintf(stderr, "%s %s %s fds=%zu active=%g churn=%zu%s\n",
+            backend.c_str(), kind.c_str(), mode.c_str(), fds, active,
+            churn, result_arr.back().skipped ? " skipped" : "");
+    }
+
+    FILE* out = opt.out ? std::fopen(opt.out, "w") : stdout;
+    if (!out) {
+        std::perror(opt.out);
+        return 1;
+    }
+    print(out, result_arr);
+    if (out != stdout) std::fclose(out);
+    return 0;
+}
@@ -0,0 +1,211 @@
+// File:     coro/Scheduler.cpp
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "Scheduler.h"
+
+// C
+#include <cerrno>
+#include <cstring>
+
+namespace iohub {
+
+thread_local Scheduler* Scheduler::current_ = nullptr;
+
+Scheduler::Scheduler(PollerBase& poller) : poller_(poller),
+        timer_seq_(0), waiting_(0) {}
+
+Scheduler::~Scheduler() {
+    // coroutines still suspended are destroyed with their frames
+    for (size_t fd = 0; fd < waiter_arr_.size(); ++fd) {
+        Waiter& waiter = waiter_arr_[fd];
+        if (waiter.reader) waiter.reader.destroy();
+        if (waiter.writer) waiter.writer.destroy();
+        if (waiter.registered) poller_.try_erase(static_cast<int>(fd));
+    }
+    for (; !timer_heap_.empty(); timer_heap_.pop())
+        timer_heap_.top().handle.destroy();
+    for (std::coroutine_handle<> handle : runnable_) handle.destroy();
+}
+
+Scheduler& Scheduler::current() noexcept {
+    return *current_;
+}
+
+void Scheduler::spawn(Task task) {
+    runnable_.push_back(task.release());
+}
+
+void Scheduler::mark(int fd) {
+    Waiter& waiter = waiter_arr_[fd];
+    if (!waiter.dirty) {
+        waiter.dirty = true;
+        dirty_arr_.push_back(fd);
+    }
+}
+
+bool Scheduler::wait_fd(int fd, int event, std::coroutine_handle<> handle,
+        int* ret) {
+    if (fd < 0) {
+        *ret = -EBADF;
+        return false;
+    }
+    if (fd >= waiter_arr_.size()) waiter_arr_.resize(fd + 1);
+    Waiter& waiter = waiter_arr_[fd];
+    std::coroutine_handle<>& slot = event == IOHUB_IN
+        ? waiter.reader : waiter.writer;
+    if (slot) {
+        *ret = -EBUSY;
+        return false;
+    }
+    slot = handle;
+    (event == IOHUB_IN ? waiter.reader_ret : waiter.writer_ret) = ret;
+    *ret = 0;
+    ++waiting_;
+    this->mark(fd);
+    return true;
+}
+
+void Scheduler::wait_until(clock::time_point deadline,
+        std::coroutine_handle<> handle) {
+    timer_heap_.push(Timer{deadline, timer_seq_++, handle});
+}
+
+void Scheduler::flush() {
+    // one poller call per changed fd, failed waits resume with the error
+    for (int fd : dirty_arr_) {
+        Waiter& waiter = waiter_arr_[fd];
+        waiter.dirty = false;
+        int events = (waiter.reader ? IOHUB_IN : 0)
+            | (waiter.writer ? IOHUB_OUT : 0);
+        if (events == waiter.registered && waiter.armed) continue;
+        int ret = 0;
+        if (!events) {
+            // the fd may be closed by now, the poller drops it anyway
+            poller_.try_erase(fd);
+            waiter.registered = 0;
+        } else if (!waiter.registered) {
+            ret = poller_.try_insert(fd, events | IOHUB_ONESHOT);
+        } else {
+            // re-arm; ENOENT: closed, the number is a new file now
+            ret = poller_.try_modify(fd, events | IOHUB_ONESHOT);
+            if (ret == -ENOENT) {
+                poller_.try_erase(fd);
+                waiter.registered = 0;
+                ret = poller_.try_insert(fd, events | IOHUB_ONESHOT);
+            }
+        }
+        if (!ret) {
+            waiter.registered = events;
+            waiter.armed = events != 0;
+            continue;
+        }
+        // nothing is armed for the waiters
+        waiter.armed = false;
+        if (waiter.reader) {
+            *waiter.reader_ret = ret;
+            runnable_.push_back(waiter.reader);
+            waiter.reader = nullptr;
+            --waiting_;
+        }
+        if (waiter.writer) {
+            *waiter.writer_ret = ret;
+            runnable_.push_back(waiter.writer);
+            waiter.writer = nullptr;
+            --waiting_;
+        }
+    }
+    dirty_arr_.clear();
+}
+
+void Scheduler::wake(int fd, int events) {
+    if (fd >= waiter_arr_.size()) return;
+    Waiter& waiter = waiter_arr_[fd];
+    // errors and hang-ups wake both sides
+    bool error = events & ~IOHUB_EVENT_MASK;
+    if (waiter.reader && (error || (events & (IOHUB_IN | IOHUB_PRI)))) {
+        running_.push_back(waiter.reader);
+        waiter.reader = nullptr;
+        --waiting_;
+    }
+    if (waiter.writer && (error || (events & IOHUB_OUT))) {
+        running_.push_back(waiter.writer);
+        waiter.writer = nullptr;
+        --waiting_;
+    }
+    // the one-shot registration fired; flush() re-arms it for the
+    // waiters left or awaiting again, or erases it
+    waiter.armed = false;
+    this->mark(fd);
+}
+
+void Scheduler::run() {
+    Scheduler* outer = current_;
+    current_ = this;
+    struct Restore {
+        Scheduler* outer;
+        ~Restore() { current_ = outer; }
+    } restore{outer};
+
+    for (;;) {
+        // the spawned, the expired and the failed waits
+        const clock::time_point now = clock::now();
+        for (; !timer_heap_.empty() && timer_heap_.top().deadline <= now;
+                timer_heap_.pop())
+            runnable_.push_back(timer_heap_.top().handle);
+        if (!runnable_.empty()) {
+            running_.swap(runnable_);
+            for (std::coroutine_handle<> handle : running_) handle.resume();
+            running_.clear();
+            continue;
+        }
+        if (!waiting_ && timer_heap_.empty()) {
+            // leave no registration behind
+            this->flush();
+            break;
+        }
+
+        // wait for the fds until the nearest timer
+        this->flush();
+        if (!runnable_.empty()) continue;
+        ready_arr_.clear();
+        auto collect = [this](int fd, int events) {
+            ready_arr_.emplace_back(fd, events);
+        };
+        ssize_t ret = timer_heap_.empty() ? poller_.try_visit(collect)
+            : poller_.try_visit_for(collect,
+                timer_heap_.top().deadline - clock::now());
+        assert_throw_iohubexcept(ret >= 0, "[Scheduler] run(): ",
+            poller_.error_detail() ? poller_.error_detail()
+            : std::strerror(static_cast<int>(-ret)));
+
+        for (const fd_event_t& ready : ready_arr_)
+            this->wake(ready.first, ready.second);
+        for (std::coroutine_handle<> handle : running_) handle.resume();
+        running_.clear();
+    }
+}
+
+} // namespace iohub
@@ -0,0 +1,164 @@
+// File:     coro/Scheduler.h
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef IOHUB_CORO_SCHEDULER_H
+#define IOHUB_CORO_SCHEDULER_H
+
+// C
+#include <cstdint>
+
+// C++
+#include <chrono>
+#include <coroutine>
+#include <functional>
+#include <queue>
+#include <vector>
+
+// iohub
+#include "PollerBase.h"
+#include "Task.h"
+
+namespace iohub {
+
+// Runs coroutines on a poller of any backend. A coroutine suspended in
+// co_await readable(fd), writable(fd) or sleep_for(d) is resumed
+// straight from the wait loop by its coroutine handle. fds are
+// registered one-shot: awaiting the same fd again costs one modify(),
+// which also registers a closed and reused fd number anew.
+// Single-threaded: spawn() and run() on the thread that owns it.
+class Scheduler {
+public:
+    using clock = std::chrono::steady_clock;
+
+private:
+    struct Waiter {
+        std::coroutine_handle<> reader, writer;
+        int* reader_ret = nullptr;
+        int* writer_ret = nullptr;
+        int registered = 0;     // events in the poller, one-shot
+        bool armed = false;     // the registration has not fired yet
+        bool dirty = false;     // queued in dirty_arr_
+    }; // coroutines waiting on an fd
+
+    struct Timer {
+        clock::time_point deadline;
+        uint64_t seq;           // FIFO among equal deadlines
+        std::coroutine_handle<> handle;
+        bool operator>(const Timer& other) const noexcept {
+            return deadline != other.deadline ? deadline > other.deadline
+                : seq > other.seq;
+        }
+    }; // sleeping coroutine
+
+    PollerBase& poller_;
+    std::vector<Waiter> waiter_arr_;
+    std::vector<int> dirty_arr_;
+    std::vector<fd_event_t> ready_arr_;
+    std::priority_queue<Timer, std::vector<Timer>,
+        std::greater<Timer>> timer_heap_;
+    std::vector<std::coroutine_handle<>> runnable_, running_;
+    uint64_t timer_seq_;
+    size_t waiting_;
+
+    static thread_local Scheduler* current_;
+
+    void mark(int fd);
+    void flush();
+    void wake(int fd, int events);
+
+public:
+    explicit Scheduler(PollerBase& poller);
+    ~Scheduler();
+
+    // uncopyable
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // start task in the next round of run()
+    void spawn(Task task);
+
+    // until every coroutine has returned
+    void run();
+
+    // the scheduler in run() on this thread
+    static Scheduler& current() noexcept;
+
+    // for the awaitables: false resumes the caller at once with *ret set
+    bool wait_fd(int fd, int event, std::coroutine_handle<> handle,
+        int* ret);
+    void wait_until(clock::time_point deadline,
+        std::coroutine_handle<> handle);
+
+}; // class Scheduler
+
+// co_await readable(fd): 0 once the fd is readable (or hung up),
+// -errno if it cannot be polled, -EBUSY if another coroutine waits
+struct FdAwaitable {
+    int fd;
+    int event;
+    int ret;
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+        return Scheduler::current().wait_fd(fd, event, handle, &ret);
+    }
+    int await_resume() const noexcept { return ret; }
+}; // awaitable of readable() and writable()
+
+struct SleepAwaitable {
+    Scheduler::clock::time_point deadline;
+
+    bool await_ready() const noexcept {
+        return deadline <= Scheduler::clock::now();
+    }
+    void await_suspend(std::coroutine_handle<> handle) {
+        Scheduler::current().wait_until(deadline, handle);
+    }
+    void await_resume() const noexcept {}
+}; // awaitable of sleep_for() and sleep_until()
+
+inline FdAwaitable readable(int fd) noexcept {
+    return FdAwaitable{fd, IOHUB_IN, 0};
+}
+
+inline FdAwaitable writable(int fd) noexcept {
+    return FdAwaitable{fd, IOHUB_OUT, 0};
+}
+
+inline SleepAwaitable sleep_until(Scheduler::clock::time_point deadline) {
+    return SleepAwaitable{deadline};
+}
+
+template <class Rep, class Period>
+SleepAwaitable sleep_for(const std::chrono::duration<Rep, Period>& d) {
+    return SleepAwaitable{Scheduler::clock::now()
+        + std::chrono::duration_cast<Scheduler::clock::duration>(d)};
+}
+
+} // namespace iohub
+
+#endif // IOHUB_CORO_SCHEDULER_H
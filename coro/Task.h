@@ -0,0 +1,183 @@
+// File:     coro/Task.h
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef IOHUB_CORO_TASK_H
+#define IOHUB_CORO_TASK_H
+
+// C
+#include <cstddef>
+
+// C++
+#include <coroutine>
+#include <exception>
+#include <new>
+#include <utility>
+
+namespace iohub {
+
+// Free lists of coroutine frames by size class, one pool per thread.
+// Frames above the largest class come from operator new.
+class FramePool {
+    static constexpr size_t GRANULE = 64;
+    static constexpr size_t CLASSES = 32;   // frames up to 2 KiB
+
+    struct Node {
+        Node* next;
+    }; // a free frame
+
+    Node* free_arr_[CLASSES] = {};
+
+    static size_t class_of(size_t size) noexcept {
+        return (size + GRANULE - 1) / GRANULE - 1;
+    }
+
+public:
+    FramePool() = default;
+    ~FramePool() {
+        for (Node*& head : free_arr_) {
+            while (head) {
+                Node* node = head;
+                head = node->next;
+                ::operator delete(node);
+            }
+        }
+    }
+
+    // uncopyable
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    static FramePool& local() noexcept {
+        thread_local FramePool pool;
+        return pool;
+    }
+
+    void* allocate(size_t size) {
+        size_t index = class_of(size);
+        if (index >= CLASSES) return ::operator new(size);
+        Node* node = free_arr_[index];
+        if (!node) return ::operator new((index + 1) * GRANULE);
+        free_arr_[index] = node->next;
+        return node;
+    }
+
+    void deallocate(void* ptr, size_t size) noexcept {
+        size_t index = class_of(size);
+        if (index >= CLASSES) return ::operator delete(ptr);
+        Node* node = static_cast<Node*>(ptr);
+        node->next = free_arr_[index];
+        free_arr_[index] = node;
+    }
+
+}; // class FramePool
+
+// Coroutine started by Scheduler::spawn() or by co_await in another
+// coroutine, its frame is freed when it returns. An awaiting coroutine
+// is resumed by symmetric transfer when the task returns, and is
+// destroyed with it if the task is destroyed suspended. An exception
+// escaping it calls std::terminate(), as one escaping a std::thread does.
+class Task {
+public:
+    struct promise_type {
+        std::coroutine_handle<> continuation;  // the awaiting coroutine
+
+        // frees the frame and resumes the awaiting coroutine, if any
+        struct FinalAwaiter {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(
+                    std::coroutine_handle<promise_type> handle) noexcept {
+                std::coroutine_handle<> next = std::exchange(
+                    handle.promise().continuation, nullptr);
+                handle.destroy();
+                return next ? next : std::noop_coroutine();
+            }
+            void await_resume() const noexcept {}
+        }; // struct FinalAwaiter
+
+        ~promise_type() {
+            if (continuation) continuation.destroy();
+        }
+
+        Task get_return_object() noexcept {
+            return Task(std::coroutine_handle<promise_type>::from_promise(
+                *this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+
+        // frames come from the pool of the thread
+        static void* operator new(size_t size) {
+            return FramePool::local().allocate(size);
+        }
+        static void operator delete(void* ptr, size_t size) noexcept {
+            FramePool::local().deallocate(ptr, size);
+        }
+    }; // promise of the coroutine
+
+    Task(Task&& other) noexcept
+        : handle_(std::exchange(other.handle_, nullptr)) {}
+    Task& operator=(Task&&) = delete;
+
+    // a task never spawned is destroyed unstarted
+    ~Task() {
+        if (handle_) handle_.destroy();
+    }
+
+    std::coroutine_handle<> release() noexcept {
+        return std::exchange(handle_, nullptr);
+    }
+
+    // starts the task in place of the awaiting coroutine
+    struct Awaiter {
+        std::coroutine_handle<promise_type> handle;
+
+        bool await_ready() const noexcept { return false; }
+        std::coroutine_handle<> await_suspend(
+                std::coroutine_handle<> awaiting) noexcept {
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+        void await_resume() const noexcept {}
+    }; // struct Awaiter
+
+    Awaiter operator co_await() && noexcept {
+        return Awaiter{std::exchange(handle_, nullptr)};
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept
+        : handle_(handle) {}
+
+}; // class Task
+
+} // namespace iohub
+
+#endif // IOHUB_CORO_TASK_H
@@ -0,0 +1,227 @@
+// File:     src/AdaptivePoller.cpp
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "AdaptivePoller.h"
+
+// C++
+#include <new>
+
+// iohub
+#include "Epoll.h"
+#include "Poll.h"
+
+namespace iohub {
+
+namespace {
+// waits between two decisions
+const size_t ADAPTIVE_WINDOW = 64;
+
+// cost of one epoll_ctl() and of one epoll_wait(), in pollfd scans
+const size_t ADAPTIVE_CTL_COST = 16;
+const size_t ADAPTIVE_WAIT_COST = 8;
+} // anonymous namespace
+
+IOHUB_INLINE
+AdaptivePoller::AdaptivePoller(Backend kind) : backend_(create(kind)),
+        kind_(kind), size_(0), wait_count_(0), ready_count_(0),
+        change_count_(0) {}
+
+IOHUB_INLINE
+std::unique_ptr<PollerBase> AdaptivePoller::create(Backend kind) {
+    if (kind == EPOLL) return std::unique_ptr<PollerBase>(new Epoll);
+    return std::unique_ptr<PollerBase>(new Poll);
+}
+
+IOHUB_INLINE
+AdaptivePoller::Entry* AdaptivePoller::find(int fd) noexcept {
+    if (fd < 0 || fd >= entry_arr_.size() || !entry_arr_[fd].events)
+        return nullptr;
+    return &entry_arr_[fd];
+}
+
+IOHUB_INLINE
+int AdaptivePoller::do_insert(int fd, int events, void* ctx) noexcept {
+    // errors
+    if (fd < 0) return this->fail(EBADF, "Invalid fd");
+    if (this->find(fd)) return this->fail(EEXIST,
+        "The fd already exists. "
+        "If you want to modify its event, "
+        "use AdaptivePoller::modify()");
+    if (fd >= entry_arr_.size()) {
+        try {
+            entry_arr_.resize(fd + 1);
+        } catch (const std::bad_alloc&) {
+            return this->fail(ENOMEM);
+        }
+    }
+
+    int ret = backend_->try_insert(fd, events, ctx);
+    if (ret) return this->fail(-ret, backend_->error_detail());
+    Entry& entry = entry_arr_[fd];
+    entry.events = events;
+    entry.ctx = ctx;
+    entry.present = true;
+    ++size_;
+    ++change_count_;
+    return 0;
+}
+
+IOHUB_INLINE
+int AdaptivePoller::do_erase(int fd) noexcept {
+    // errors
+    Entry* entry = this->find(fd);
+    if (!entry) return this->fail(ENOENT, "The fd does not exist");
+
+    if (entry->present) {
+        int ret = backend_->try_erase(fd);
+        if (ret) return this->fail(-ret, backend_->error_detail());
+    }
+    *entry = Entry();
+    --size_;
+    ++change_count_;
+    return 0;
+}
+
+IOHUB_INLINE
+int AdaptivePoller::do_modify(int fd, int events) noexcept {
+    // keep the context
+    Entry* entry = this->find(fd);
+    return this->do_modify(fd, events, entry ? entry->ctx : nullptr);
+}
+
+IOHUB_INLINE
+int AdaptivePoller::do_modify(int fd, int events, void* ctx) noexcept {
+    // errors
+    Entry* entry = this->find(fd);
+    if (!entry) return this->fail(ENOENT, "The fd does not exist");
+
+    // disarmed fds are left out by a migration
+    int ret = entry->present ? backend_->try_modify(fd, events, ctx)
+        : backend_->try_insert(fd, events, ctx);
+    if (ret) return this->fail(-ret, backend_->error_detail());
+    entry->events = events;
+    entry->ctx = ctx;
+    entry->disarmed = false;
+    entry->present = true;
+    ++change_count_;
+    return 0;
+}
+
+IOHUB_INLINE
+size_t AdaptivePoller::do_size() const noexcept {
+    // return number of fds
+    return size_;
+}
+
+IOHUB_INLINE
+void AdaptivePoller::do_clear() noexcept {
+    backend_->clear();
+    entry_arr_.clear();
+    size_ = 0;
+}
+
+IOHUB_INLINE
+void AdaptivePoller::on_event(void* arg, int fd, int events, void* ctx) {
+    Visit& visit = *static_cast<Visit*>(arg);
+    Entry& entry = visit.poller->entry_arr_[fd];
+    if (entry.events & IOHUB_ONESHOT) entry.disarmed = true;
+    visit.visitor(visit.arg, fd, events, ctx);
+}
+
+IOHUB_INLINE
+ssize_t AdaptivePoller::do_wait(visitor_t visitor, void* arg,
+        const timespec* timeout) {
+    // errors
+    if (!backend_->is_open())
+        return this->fail(EBADF, "AdaptivePoller is closed");
+
+    if (++wait_count_ == ADAPTIVE_WINDOW) this->evaluate();
+    Visit visit{this, visitor, arg};
+    ssize_t count = wait_on(*backend_, &AdaptivePoller::on_event,
+        &visit, timeout);
+    if (count < 0) return this->fail(-count, backend_->error_detail());
+    ready_count_ += count;
+    return count;
+}
+
+IOHUB_INLINE
+const char* AdaptivePoller::name() const noexcept {
+    return "AdaptivePoller";
+}
+
+IOHUB_INLINE
+void AdaptivePoller::evaluate() {
+    // per wait: Poll scans every fd, Epoll pays for the ready fds
+    // and one syscall per change
+    size_t poll_cost = size_ * wait_count_;
+    size_t epoll_cost = ready_count_ + ADAPTIVE_WAIT_COST * wait_count_
+        + ADAPTIVE_CTL_COST * change_count_;
+    wait_count_ = ready_count_ = change_count_ = 0;
+
+    // switch only when clearly cheaper
+    if (kind_ == POLL && epoll_cost * 2 < poll_cost) this->migrate(EPOLL);
+    else if (kind_ == EPOLL && poll_cost * 2 < epoll_cost) this->migrate(POLL);
+}
+
+IOHUB_INLINE
+void AdaptivePoller::migrate(Backend kind) {
+    std::unique_ptr<PollerBase> backend;
+    try {
+        backend = create(kind);
+    } catch (const std::exception&) {
+        return;
+    }
+    // a disarmed one-shot fd stays out until modify()
+    for (size_t fd = 0; fd < entry_arr_.size(); ++fd) {
+        const Entry& entry = entry_arr_[fd];
+        // e.g. an fd closed without erase(), stay on the old backend
+        if (entry.events && !entry.disarmed
+                && backend->try_insert(fd, entry.events, entry.ctx))
+            return;
+    }
+    for (Entry& entry : entry_arr_)
+        entry.present = entry.events && !entry.disarmed;
+    backend_ = std::move(backend);
+    kind_ = kind;
+}
+
+IOHUB_INLINE
+bool AdaptivePoller::is_open() const noexcept {
+    return backend_->is_open();
+}
+
+IOHUB_INLINE
+void AdaptivePoller::close() noexcept {
+    this->clear();
+    backend_->close();
+}
+
+IOHUB_INLINE
+AdaptivePoller::Backend AdaptivePoller::backend() const noexcept {
+    return kind_;
+}
+
+} // namespace iohub
@@ -0,0 +1,108 @@
+// File:     src/AdaptivePoller.h
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef IOHUB_ADAPTIVE_POLLER_H
+#define IOHUB_ADAPTIVE_POLLER_H
+
+// C++
+#include <memory>
+#include <vector>
+
+// iohub
+#include "except.h"
+#include "PollerBase.h"
+
+namespace iohub {
+
+// Poller that runs on Poll or Epoll and moves all registrations to the
+// cheaper one as the fd count, ready ratio and registration churn change.
+// Poll suits a few busy fds, Epoll large idle sets. The switch happens
+// at the start of a wait and is invisible to the caller.
+class AdaptivePoller : public PollerBase {
+public:
+    enum Backend {
+        POLL,
+        EPOLL,
+    }; // current backend
+
+private:
+    struct Entry {
+        int events = 0;         // registered events, 0 if not registered
+        void* ctx = nullptr;
+        bool disarmed = false;  // one-shot fd after its event
+        bool present = false;   // registered in backend_
+    }; // shadow registration
+
+    struct Visit {
+        AdaptivePoller* poller;
+        visitor_t visitor;
+        void* arg;
+    }; // wraps the caller's visitor
+
+    std::unique_ptr<PollerBase> backend_;
+    Backend kind_;
+    std::vector<Entry> entry_arr_;
+    size_t size_;
+
+    // statistics since the last decision
+    size_t wait_count_, ready_count_, change_count_;
+
+    static void on_event(void* arg, int fd, int events, void* ctx);
+    static std::unique_ptr<PollerBase> create(Backend kind);
+    Entry* find(int fd) noexcept;
+    void evaluate();
+    void migrate(Backend kind);
+
+public:
+    explicit AdaptivePoller(Backend kind = POLL);
+    virtual ~AdaptivePoller() override = default;
+
+    virtual const char* name() const noexcept override;
+    virtual bool is_open() const noexcept override;
+    virtual void close() noexcept override;
+
+    Backend backend() const noexcept;
+
+protected:
+    virtual int do_insert(int fd, int events, void* ctx) noexcept override;
+    virtual int do_erase(int fd) noexcept override;
+    virtual int do_modify(int fd, int events) noexcept override;
+    virtual int do_modify(int fd, int events, void* ctx) noexcept override;
+    virtual size_t do_size() const noexcept override;
+    virtual void do_clear() noexcept override;
+    virtual ssize_t do_wait(visitor_t visitor, void* arg,
+        const timespec* timeout) override;
+
+}; // class AdaptivePoller
+
+} // namespace iohub
+
+#if IOHUB_HEADER_ONLY
+#include "AdaptivePoller.cpp"
+#endif
+
+#endif // IOHUB_ADAPTIVE_POLLER_H
@@ -0,0 +1,253 @@
+// File:     src/Buffer.cpp
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "Buffer.h"
+
+// C
+#include <cerrno>
+#include <cstring>
+
+// Linux
+#include <unistd.h>
+
+namespace iohub {
+
+namespace {
+// fresh chunks offered to each readv() after the tail's free space
+const size_t BUFFER_READ_CHUNKS = 4;
+
+// iovecs of each writev()
+const size_t BUFFER_WRITE_IOVS = 64;
+} // anonymous namespace
+
+IOHUB_INLINE
+Buffer::Buffer(BufferPool& pool) noexcept : pool_(&pool),
+        head_(nullptr), tail_(nullptr), size_(0) {}
+
+IOHUB_INLINE
+Buffer::~Buffer() {
+    this->clear();
+}
+
+IOHUB_INLINE
+Buffer::Buffer(Buffer&& other) noexcept : pool_(other.pool_),
+        head_(other.head_), tail_(other.tail_), size_(other.size_) {
+    other.head_ = other.tail_ = nullptr;
+    other.size_ = 0;
+}
+
+IOHUB_INLINE
+Buffer& Buffer::operator=(Buffer&& other) noexcept {
+    if (this != &other) {
+        this->clear();
+        pool_ = other.pool_;
+        head_ = other.head_;
+        tail_ = other.tail_;
+        size_ = other.size_;
+        other.head_ = other.tail_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+IOHUB_INLINE
+void Buffer::pop_front() noexcept {
+    Chunk* chunk = head_;
+    head_ = chunk->next;
+    if (!head_) tail_ = nullptr;
+    pool_->release(chunk);
+}
+
+IOHUB_INLINE
+size_t Buffer::size() const noexcept {
+    return size_;
+}
+
+IOHUB_INLINE
+bool Buffer::empty() const noexcept {
+    return !size_;
+}
+
+IOHUB_INLINE
+void Buffer::append(const void* data, size_t len) {
+    const char* src = static_cast<const char*>(data);
+    const size_t chunk_size = pool_->chunk_size();
+    while (len) {
+        if (!tail_ || tail_->end == chunk_size) {
+            Chunk* chunk = pool_->acquire();
+            if (tail_) tail_->next = chunk;
+            else head_ = chunk;
+            tail_ = chunk;
+        }
+        size_t n = chunk_size - tail_->end;
+        if (n > len) n = len;
+        std::memcpy(tail_->data() + tail_->end, src, n);
+        tail_->end += n;
+        size_ += n;
+        src += n;
+        len -= n;
+    }
+}
+
+IOHUB_INLINE
+size_t Buffer::read(void* out, size_t len) noexcept {
+    char* dst = static_cast<char*>(out);
+    size_t copied = 0;
+    while (head_ && copied < len) {
+        size_t n = head_->end - head_->begin;
+        if (n > len - copied) n = len - copied;
+        std::memcpy(dst + copied, head_->data() + head_->begin, n);
+        copied += n;
+        this->consume(n);
+    }
+    return copied;
+}
+
+IOHUB_INLINE
+void Buffer::consume(size_t len) noexcept {
+    if (len > size_) len = size_;
+    size_ -= len;
+    while (len) {
+        size_t n = head_->end - head_->begin;
+        if (n > len) {
+            head_->begin += len;
+            return;
+        }
+        len -= n;
+        this->pop_front();
+    }
+    // a drained chunk goes back at once
+    if (head_ && head_->begin == head_->end) this->pop_front();
+}
+
+IOHUB_INLINE
+void Buffer::clear() noexcept {
+    while (head_) this->pop_front();
+    size_ = 0;
+}
+
+IOHUB_INLINE
+size_t Buffer::peek(iovec* iov, size_t max) const noexcept {
+    size_t count = 0;
+    for (Chunk* chunk = head_; chunk && count < max; chunk = chunk->next) {
+        if (chunk->begin == chunk->end) continue;
+        iov[count].iov_base = chunk->data() + chunk->begin;
+        iov[count].iov_len = chunk->end - chunk->begin;
+        ++count;
+    }
+    return count;
+}
+
+IOHUB_INLINE
+ssize_t Buffer::read_fd(int fd, bool& eof) {
+    const size_t chunk_size = pool_->chunk_size();
+    size_t total = 0;
+    eof = false;
+    for (;;) {
+        // the free space of the tail, then fresh chunks
+        iovec iov[BUFFER_READ_CHUNKS + 1];
+        size_t iov_count = 0;
+        if (tail_ && tail_->end != chunk_size) {
+            iov[0].iov_base = tail_->data() + tail_->end;
+            iov[0].iov_len = chunk_size - tail_->end;
+            iov_count = 1;
+        }
+        Chunk* fresh[BUFFER_READ_CHUNKS];
+        size_t fresh_count = 0;
+        try {
+            for (; fresh_count < BUFFER_READ_CHUNKS; ++fresh_count)
+                fresh[fresh_count] = pool_->acquire();
+        } catch (...) {
+            while (fresh_count) pool_->release(fresh[--fresh_count]);
+            throw;
+        }
+        for (size_t i = 0; i < fresh_count; ++i) {
+            iov[iov_count].iov_base = fresh[i]->data();
+            iov[iov_count].iov_len = chunk_size;
+            ++iov_count;
+        }
+
+        ssize_t ret = ::readv(fd, iov, static_cast<int>(iov_count));
+        if (ret <= 0) {
+            for (size_t i = 0; i < fresh_count; ++i) pool_->release(fresh[i]);
+            if (ret == -1 && errno == EINTR) continue;
+            // a short read does not mean drained on a socket, only
+            // EAGAIN does; an error after data is left to the next call
+            if (ret == 0) eof = true;
+            if (total || ret == 0) break;
+            return -errno;
+        }
+
+        // fill the tail, then link the fresh chunks that got data
+        size_t left = static_cast<size_t>(ret);
+        if (tail_ && tail_->end != chunk_size) {
+            size_t n = chunk_size - tail_->end;
+            if (n > left) n = left;
+            tail_->end += n;
+            left -= n;
+        }
+        for (size_t i = 0; i < fresh_count; ++i) {
+            if (!left) {
+                pool_->release(fresh[i]);
+                continue;
+            }
+            fresh[i]->end = left < chunk_size ? left : chunk_size;
+            left -= fresh[i]->end;
+            if (tail_) tail_->next = fresh[i];
+            else head_ = fresh[i];
+            tail_ = fresh[i];
+        }
+        size_ += ret;
+        total += ret;
+    }
+    return static_cast<ssize_t>(total);
+}
+
+IOHUB_INLINE
+ssize_t Buffer::write_fd(int fd) noexcept {
+    size_t total = 0;
+    while (size_) {
+        iovec iov[BUFFER_WRITE_IOVS];
+        size_t iov_count = this->peek(iov, BUFFER_WRITE_IOVS);
+        size_t offered = 0;
+        for (size_t i = 0; i < iov_count; ++i) offered += iov[i].iov_len;
+
+        ssize_t ret = ::writev(fd, iov, static_cast<int>(iov_count));
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            if (total) break;
+            return -errno;
+        }
+        this->consume(ret);
+        total += ret;
+
+        // a short write filled the fd's buffer
+        if (static_cast<size_t>(ret) < offered) break;
+    }
+    return static_cast<ssize_t>(total);
+}
+
+} // namespace iohub
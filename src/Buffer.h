@@ -0,0 +1,96 @@
+// File:     src/Buffer.h
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef IOHUB_BUFFER_H
+#define IOHUB_BUFFER_H
+
+// C
+#include <cstddef>
+
+// Linux
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// iohub
+#include "BufferPool.h"
+
+namespace iohub {
+
+// Byte queue in a chain of pool chunks, e.g. the input and the output
+// buffer of a connection. An empty buffer holds no chunk, so an idle
+// connection costs sizeof(Buffer) only.
+class Buffer {
+    using Chunk = BufferPool::Chunk;
+
+    BufferPool* pool_;
+    Chunk* head_;
+    Chunk* tail_;
+    size_t size_;
+
+    void pop_front() noexcept;
+
+public:
+    explicit Buffer(BufferPool& pool) noexcept;
+    ~Buffer();
+
+    // movable, uncopyable
+    Buffer(Buffer&& other) noexcept;
+    Buffer& operator=(Buffer&& other) noexcept;
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+
+    size_t size() const noexcept;
+    bool empty() const noexcept;
+
+    void append(const void* data, size_t len);
+
+    // copy out and consume up to len bytes, returns the bytes copied
+    size_t read(void* out, size_t len) noexcept;
+    void consume(size_t len) noexcept;
+    void clear() noexcept;
+
+    // the data as up to max iovecs, returns the iovecs filled
+    size_t peek(iovec* iov, size_t max) const noexcept;
+
+    // readv() into the non-blocking fd until EAGAIN or EOF: the bytes
+    // read, or -errno if none (-EAGAIN if nothing was ready). eof is set
+    // if the peer closed, also when bytes were read before it.
+    ssize_t read_fd(int fd, bool& eof);
+
+    // writev() from the chain until it is empty or the fd would block:
+    // the bytes written or -errno
+    ssize_t write_fd(int fd) noexcept;
+
+}; // class Buffer
+
+} // namespace iohub
+
+#if IOHUB_HEADER_ONLY
+#include "Buffer.cpp"
+#endif
+
+#endif // IOHUB_BUFFER_H
@@ -0,0 +1,95 @@
+// File:     src/BufferPool.cpp
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "BufferPool.h"
+
+namespace iohub {
+
+IOHUB_INLINE
+BufferPool::BufferPool(size_t chunk_size, size_t slab_chunks)
+        : chunk_size_(chunk_size), slab_chunks_(slab_chunks),
+        stride_(0), free_list_(nullptr), free_count_(0) {
+    // exceptions
+    assert_throw_iohubexcept(chunk_size && slab_chunks,
+        "[BufferPool] Chunk size and slab chunks must not be 0");
+
+    // keep the headers aligned
+    const size_t align = alignof(Chunk);
+    stride_ = (sizeof(Chunk) + chunk_size_ + align - 1) / align * align;
+}
+
+IOHUB_INLINE
+BufferPool::~BufferPool() {
+    for (char* slab : slab_arr_) delete[] slab;
+}
+
+IOHUB_INLINE
+void BufferPool::grow() {
+    slab_arr_.reserve(slab_arr_.size() + 1);
+    char* slab = new char[stride_ * slab_chunks_];
+    slab_arr_.push_back(slab);
+    for (size_t i = slab_chunks_; i--; ) {
+        Chunk* chunk = reinterpret_cast<Chunk*>(slab + i * stride_);
+        chunk->next = free_list_;
+        free_list_ = chunk;
+    }
+    free_count_ += slab_chunks_;
+}
+
+IOHUB_INLINE
+BufferPool::Chunk* BufferPool::acquire() {
+    if (!free_list_) this->grow();
+    Chunk* chunk = free_list_;
+    free_list_ = chunk->next;
+    --free_count_;
+    chunk->next = nullptr;
+    chunk->begin = chunk->end = 0;
+    return chunk;
+}
+
+IOHUB_INLINE
+void BufferPool::release(Chunk* chunk) noexcept {
+    chunk->next = free_list_;
+    free_list_ = chunk;
+    ++free_count_;
+}
+
+IOHUB_INLINE
+size_t BufferPool::chunk_size() const noexcept {
+    return chunk_size_;
+}
+
+IOHUB_INLINE
+size_t BufferPool::free_count() const noexcept {
+    return free_count_;
+}
+
+IOHUB_INLINE
+size_t BufferPool::capacity() const noexcept {
+    return slab_arr_.size() * slab_chunks_;
+}
+
+} // namespace iohub
@@ -0,0 +1,88 @@
+// File:     src/BufferPool.h
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef IOHUB_BUFFER_POOL_H
+#define IOHUB_BUFFER_POOL_H
+
+// C
+#include <cstddef>
+
+// C++
+#include <vector>
+
+// iohub
+#include "except.h"
+
+namespace iohub {
+
+// Fixed-size chunks carved from slabs of slab_chunks chunks, recycled
+// through a free list. Freed chunks stay in the pool, so its memory is
+// the peak in use. Not thread-safe, use one pool per loop thread.
+class BufferPool {
+public:
+    struct Chunk {
+        Chunk* next;
+        size_t begin, end;      // data is data()[begin, end)
+
+        char* data() noexcept {
+            return reinterpret_cast<char*>(this + 1);
+        }
+    }; // header of a chunk, its bytes follow it
+
+private:
+    size_t chunk_size_, slab_chunks_, stride_;
+    std::vector<char*> slab_arr_;
+    Chunk* free_list_;
+    size_t free_count_;
+
+    void grow();
+
+public:
+    explicit BufferPool(size_t chunk_size = 16384, size_t slab_chunks = 64);
+    ~BufferPool();
+
+    // uncopyable
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // an empty chunk, throws std::bad_alloc
+    Chunk* acquire();
+    void release(Chunk* chunk) noexcept;
+
+    size_t chunk_size() const noexcept;
+    size_t free_count() const noexcept;
+    size_t capacity() const noexcept;
+
+}; // class BufferPool
+
+} // namespace iohub
+
+#if IOHUB_HEADER_ONLY
+#include "BufferPool.cpp"
+#endif
+
+#endif // IOHUB_BUFFER_POOL_H
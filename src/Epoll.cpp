@@ -26,114 +26,308 @@
 
 #include "Epoll.h"
 
+// C++
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+// C
+#include <climits>
+
+// Linux
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+// busy poll parameters, missing from older headers
+#ifndef EPIOCSPARAMS
+struct epoll_params {
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t __pad;
+};
+#define EPIOCSPARAMS _IOW(0x8A, 0x01, struct epoll_params)
+#endif
+
 namespace iohub {
 
 namespace {
 const size_t EPOLL_WAIT_BUFSIZE = 4096;
+
+// epoll_pwait2() (Linux 5.11) takes the timespec, older kernels get
+// epoll_wait() with the timeout rounded up to ms
+std::atomic<bool> has_epoll_pwait2(true);
+
+int epoll_wait_ts(int epfd, epoll_event* events, int maxevents,
+        const timespec* timeout) {
+#if defined(__NR_epoll_pwait2) && __SIZEOF_POINTER__ == 8
+    if (has_epoll_pwait2.load(std::memory_order_relaxed)) {
+        int ret = static_cast<int>(::syscall(__NR_epoll_pwait2, epfd,
+            events, maxevents, timeout, nullptr, 0));
+        if (ret != -1 || errno != ENOSYS) return ret;
+        has_epoll_pwait2.store(false, std::memory_order_relaxed);
+    }
+#endif
+    int ms = -1;
+    if (timeout) {
+        int64_t ns = timeout->tv_sec * 1000000000LL + timeout->tv_nsec;
+        int64_t rounded = (ns + 999999) / 1000000;
+        ms = rounded > INT_MAX ? INT_MAX : static_cast<int>(rounded);
+    }
+    return epoll_wait(epfd, events, maxevents, ms);
+}
+const int EPOLL_SLOT_PAGE_BITS = 10;
+const int EPOLL_SLOT_PAGE_SIZE = 1 << EPOLL_SLOT_PAGE_BITS;
 }
 
+// events and trigger modes are passed to the kernel as is
+static_assert(+IOHUB_IN == +EPOLLIN && +IOHUB_PRI == +EPOLLPRI
+    && +IOHUB_OUT == +EPOLLOUT, "Epoll: event bits mismatch");
+static_assert(+IOHUB_ET == +EPOLLET && +IOHUB_ONESHOT == +EPOLLONESHOT
+    && +IOHUB_EXCLUSIVE == +EPOLLEXCLUSIVE, "Epoll: mode bits mismatch");
+
+IOHUB_INLINE
 Epoll::Epoll() : epoll_fd_(epoll_create(1)), size_(0),
-        event_arr_(new epoll_event[EPOLL_WAIT_BUFSIZE]) {
+        event_arr_(new epoll_event[EPOLL_WAIT_BUFSIZE]), wait_gen_(0),
+        busy_usecs_(0), busy_budget_(0), busy_prefer_(false) {
     assert_throw_iohubexcept(epoll_fd_ >= 0,
         "[Epoll] Epoll create failed, ", LAST_ERROR);
 }
 
-void Epoll::insert(int fd, int events) {
-    // exceptions
-    assert_throw_iohubexcept(epoll_fd_ != -1,
-        "[Epoll] insert(): Epoll is closed");
-    assert_throw_iohubexcept(fd >= 0,
-        "[Epoll] insert(): Invalid fd");
-    assert_throw_iohubexcept(events,
-        "[Epoll] insert(): Events is empty. "
+IOHUB_INLINE
+Epoll::~Epoll() {
+    this->close();
+    delete[] event_arr_;
+}
+
+IOHUB_INLINE
+Epoll::Slot* Epoll::slot(int fd, bool create) noexcept {
+    size_t page = fd >> EPOLL_SLOT_PAGE_BITS;
+    if (page >= slot_pages_.size() || !slot_pages_[page]) {
+        if (!create) return nullptr;
+        try {
+            if (page >= slot_pages_.size()) slot_pages_.resize(page + 1);
+            slot_pages_[page].reset(new Slot[EPOLL_SLOT_PAGE_SIZE]);
+        } catch (const std::bad_alloc&) {
+            return nullptr;
+        }
+    }
+    return &slot_pages_[page][fd & (EPOLL_SLOT_PAGE_SIZE - 1)];
+}
+
+IOHUB_INLINE
+int Epoll::do_insert(int fd, int events, void* ctx) noexcept {
+    // errors
+    if (epoll_fd_ == -1) return this->fail(EBADF, "Epoll is closed");
+    if (fd < 0) return this->fail(EBADF, "Invalid fd");
+    if (!events) return this->fail(EINVAL,
+        "Events is empty. "
         "If you want to remove fd from epoll, "
         "use Epoll::erase()");
 
+    Slot* fd_slot = this->slot(fd, true);
+    if (!fd_slot) return this->fail(ENOMEM);
     epoll_event event{};
-    event.data.fd = fd;
+    event.data.ptr = fd_slot;
     event.events = events;
     int ret = epoll_ctl(epoll_fd_,
         EPOLL_CTL_ADD, fd, &event);
-    assert_throw_iohubexcept(ret == 0,
-        "[Epoll] insert(): ", LAST_ERROR);
+    if (ret) return this->fail(errno);
+    fd_slot->fd = fd;
+    fd_slot->events = events;
+    fd_slot->ctx = ctx;
     ++size_;
+    return 0;
 }
 
-void Epoll::erase(int fd) {
-    // exceptions
-    assert_throw_iohubexcept(epoll_fd_ != -1,
-        "[Epoll] erase(): Epoll is closed");
-    assert_throw_iohubexcept(fd >= 0,
-        "[Epoll] erase(): Invalid fd");
+IOHUB_INLINE
+int Epoll::do_erase(int fd) noexcept {
+    // errors
+    if (epoll_fd_ == -1) return this->fail(EBADF, "Epoll is closed");
+    if (fd < 0) return this->fail(EBADF, "Invalid fd");
 
     int ret = epoll_ctl(epoll_fd_,
         EPOLL_CTL_DEL, fd, nullptr);
-    assert_throw_iohubexcept(ret == 0,
-        "[Epoll] erase(): ", LAST_ERROR);
+    Slot* fd_slot = this->slot(fd);
+    // closed without erase(), the kernel dropped it already: drop the
+    // slot too, else it would hide the fd number from insert()
+    if (ret && !((errno == EBADF || errno == ENOENT)
+            && fd_slot && fd_slot->events))
+        return this->fail(errno);
+    fd_slot->fd = -1;
+    fd_slot->events = 0;
+    fd_slot->ctx = nullptr;
     --size_;
+    return 0;
 }
 
-void Epoll::modify(int fd, int events) { 
-    // exceptions
-    assert_throw_iohubexcept(epoll_fd_ != -1,
-        "[Epoll] modify(): Epoll is closed");
-    assert_throw_iohubexcept(fd >= 0,
-        "[Epoll] modify(): Invalid fd"); 
-    assert_throw_iohubexcept(events,
-        "[Epoll] modify(): Events is empty. "
+IOHUB_INLINE
+int Epoll::do_modify(int fd, int events) noexcept {
+    // keep the context
+    Slot* fd_slot = fd >= 0 ? this->slot(fd) : nullptr;
+    return this->do_modify(fd, events, fd_slot ? fd_slot->ctx : nullptr);
+}
+
+IOHUB_INLINE
+int Epoll::do_modify(int fd, int events, void* ctx) noexcept {
+    // errors
+    if (epoll_fd_ == -1) return this->fail(EBADF, "Epoll is closed");
+    if (fd < 0) return this->fail(EBADF, "Invalid fd");
+    if (!events) return this->fail(EINVAL,
+        "Events is empty. "
         "If you want to remove fd from epoll, "
         "use Epoll::erase()");
+    if (events & IOHUB_EXCLUSIVE) return this->fail(EINVAL,
+        "IOHUB_EXCLUSIVE can only be set by insert()");
+
+    // an fd without a slot was never inserted
+    Slot* fd_slot = this->slot(fd);
+    if (!fd_slot) return this->fail(ENOENT);
+
+    // same level-triggered interest, nothing for the kernel to do;
+    // one-shot needs the re-arm and edge-triggered the new edge check
+    if (events == fd_slot->events
+            && !(events & (IOHUB_ONESHOT | IOHUB_ET))) {
+        fd_slot->ctx = ctx;
+        return 0;
+    }
+    return this->ctl_modify(fd, fd_slot, events, ctx);
+}
 
+IOHUB_INLINE
+int Epoll::ctl_modify(int fd, Slot* fd_slot, int events, void* ctx) noexcept {
     // modify the fd event from epoll
     epoll_event event{};
-    event.data.fd = fd;
+    event.data.ptr = fd_slot;
     event.events = events;
     int ret = epoll_ctl(epoll_fd_,
         EPOLL_CTL_MOD, fd, &event);
-    assert_throw_iohubexcept(!ret,
-        "[Epoll] modify(): ", LAST_ERROR);
+    if (ret) return this->fail(errno);
+    fd_slot->events = events;
+    fd_slot->ctx = ctx;
+    return 0;
 }
 
-size_t Epoll::size() const noexcept {
+IOHUB_INLINE
+void Epoll::upsert(int fd, int events, void* ctx) {
+    this->check(this->try_upsert(fd, events, ctx), "upsert()");
+}
+
+IOHUB_INLINE
+int Epoll::try_upsert(int fd, int events, void* ctx) noexcept {
+    Slot* fd_slot = fd >= 0 ? this->slot(fd) : nullptr;
+    if (fd_slot && fd_slot->events) {
+        // always ask the kernel: the fd may be a new file by now
+        int ret = this->ctl(IOHUB_CTL_MODIFY, [&] {
+            if (events & IOHUB_EXCLUSIVE) return this->fail(EINVAL,
+                "IOHUB_EXCLUSIVE can only be set by insert()");
+            return this->ctl_modify(fd, fd_slot, events, ctx);
+        });
+        if (ret != -ENOENT) return ret;
+        // closed without erase(), the kernel dropped it
+        fd_slot->fd = -1;
+        fd_slot->events = 0;
+        --size_;
+    }
+    return this->ctl(IOHUB_CTL_INSERT, [&] {
+        return this->Epoll::do_insert(fd, events, ctx);
+    });
+}
+
+IOHUB_INLINE
+size_t Epoll::do_size() const noexcept {
     // return number of fds
     return size_;
 }
 
-void Epoll::clear() noexcept {
+IOHUB_INLINE
+void Epoll::do_clear() noexcept {
     ::close(epoll_fd_);
     epoll_fd_ = epoll_create(1);
+    size_ = 0;
+    for (std::unique_ptr<Slot[]>& page : slot_pages_) {
+        if (page) std::fill(page.get(), page.get() + EPOLL_SLOT_PAGE_SIZE,
+            Slot());
+    }
+    if (busy_usecs_) this->apply_busy_poll();
 }
 
-size_t Epoll::wait(std::vector<fd_event_t>& fdevt_arr, int timeout) {
-    // exceptions
-    assert_throw_iohubexcept(epoll_fd_ != -1,
-        "[Epoll] wait(): Epoll is closed");
-    assert_throw_iohubexcept(size_,
-        "[Epoll] wait(): Epoll is empty");
+IOHUB_INLINE
+ssize_t Epoll::do_wait(visitor_t visitor, void* arg,
+        const timespec* timeout) {
+    // errors
+    if (epoll_fd_ == -1) return this->fail(EBADF, "Epoll is closed");
+    if (!size_) return this->fail(ENOENT, "Epoll is empty");
 
-    fdevt_arr.clear();
-    int ret = 0, result = 0;
+    size_t result = 0;
+    int ret = 0, max_events = EPOLL_WAIT_BUFSIZE;
+    const uint64_t gen = ++wait_gen_;
+    const timespec zero{0, 0};
     do {
-        ret = epoll_wait(epoll_fd_, event_arr_, EPOLL_WAIT_BUFSIZE, timeout);
-        if (ret == 0) return result;
-        timeout = 0;
-        assert_throw_iohubexcept(ret > 0,
-            "[Epoll] wait(): ", LAST_ERROR);
-        // push
-        fdevt_arr.resize(result + ret);
-        for (size_t cnt = result; cnt < ret; ++cnt) {
-            fdevt_arr[cnt++] = {static_cast<int>(event_arr_[cnt].data.fd),
-                static_cast<int>(event_arr_[cnt].events)};
+        ret = epoll_wait_ts(epoll_fd_, event_arr_, max_events, timeout);
+        // a signal is not an error, wait() returns early
+        if (ret == 0 || (ret == -1 && errno == EINTR)) return result;
+        // an error after a full buffer keeps the events already visited
+        if (ret < 0) return result ? result : this->fail(errno);
+        timeout = &zero;
+        // visit the result buffer, once per fd
+        int fresh = 0;
+        for (int i = 0; i < ret; ++i) {
+            Slot& fd_slot = *static_cast<Slot*>(event_arr_[i].data.ptr);
+            if (fd_slot.seen == gen) continue;
+            fd_slot.seen = gen;
+            visitor(arg, fd_slot.fd,
+                static_cast<int>(event_arr_[i].events), fd_slot.ctx);
+            ++fresh;
         }
-        result += ret;
-    } while (ret == EPOLL_WAIT_BUFSIZE);
-    return result;
+        result += fresh;
+        // the kernel returns the unread fds first, then the reported
+        // level-triggered fds again; stop at a short buffer or at the
+        // first fd already visited in this call
+        if (ret != max_events || fresh != ret || result >= size_) break;
+        if (size_ - result < EPOLL_WAIT_BUFSIZE)
+            max_events = static_cast<int>(size_ - result);
+        this->count_refill();
+    } while (true);
+    return static_cast<ssize_t>(result);
+}
+
+IOHUB_INLINE
+const char* Epoll::name() const noexcept {
+    return "Epoll";
 }
 
+IOHUB_INLINE
 bool Epoll::is_open() const noexcept {
     return epoll_fd_ != -1;
 }
 
+IOHUB_INLINE
+bool Epoll::set_busy_poll(uint32_t usecs, uint16_t budget, bool prefer) {
+    // exceptions
+    assert_throw_iohubexcept(epoll_fd_ != -1,
+        "[Epoll] set_busy_poll(): Epoll is closed");
+
+    busy_usecs_ = usecs;
+    busy_budget_ = budget;
+    busy_prefer_ = prefer;
+    if (this->apply_busy_poll()) return true;
+    busy_usecs_ = 0;
+    assert_throw_iohubexcept(errno == ENOTTY || errno == EINVAL,
+        "[Epoll] set_busy_poll(): ", LAST_ERROR);
+    return false;
+}
+
+IOHUB_INLINE
+bool Epoll::apply_busy_poll() {
+    epoll_params params{};
+    params.busy_poll_usecs = busy_usecs_;
+    params.busy_poll_budget = busy_budget_;
+    params.prefer_busy_poll = busy_prefer_;
+    return ::ioctl(epoll_fd_, EPIOCSPARAMS, &params) == 0;
+}
+
+IOHUB_INLINE
 void Epoll::close() noexcept {
     if (epoll_fd_ != -1) {
         this->clear();
@@ -28,7 +28,11 @@
 #ifndef IOHUB_EPOLL_H
 #define IOHUB_EPOLL_H
 
+// C
+#include <cstdint>
+
 // C++
+#include <memory>
 #include <unordered_map>
 
 // Linux
@@ -42,29 +46,68 @@
 namespace iohub {
 
 class Epoll : public PollerBase {
+    struct Slot {
+        int fd = -1;
+        int events = 0;         // registered events, 0 if not registered
+        void* ctx = nullptr;
+        uint64_t seen = 0;      // last wait that visited the fd
+    }; // pointed by epoll_data.ptr, never moves
 
     int epoll_fd_;
     size_t size_;
     epoll_event* event_arr_;
+    uint64_t wait_gen_;
+    std::vector<std::unique_ptr<Slot[]>> slot_pages_;
 
-public:
-    Epoll();
-    virtual ~Epoll() = default;
+    // busy poll parameters, applied again by clear()
+    uint32_t busy_usecs_;
+    uint16_t busy_budget_;
+    bool busy_prefer_;
 
-    virtual void insert(int fd, int events) override;
-    virtual void erase(int fd) override;
-    virtual void modify(int fd, int events) override;
-    virtual size_t size() const noexcept override;
-    virtual void clear() noexcept override;
+    // nullptr if the fd never had a slot, or create failed
+    Slot* slot(int fd, bool create = false) noexcept;
+    int ctl_modify(int fd, Slot* fd_slot, int events, void* ctx) noexcept;
+    bool apply_busy_poll();
 
-    virtual size_t wait(std::vector<fd_event_t>& fdevt_arr,
-        int timeout = -1) override;
+public:
+    Epoll();
+    virtual ~Epoll() override;
 
+    virtual const char* name() const noexcept override;
     virtual bool is_open() const noexcept override;
     virtual void close() noexcept override;
 
+    // modify() with the same level-triggered events as registered does
+    // not reach the kernel, so it cannot report an fd closed without
+    // erase(). erase() an fd before closing it, or register the reused
+    // fd with upsert(). erase() after the close still drops the fd.
+
+    // insert() or modify() as the fd is registered or not; the modify
+    // always reaches the kernel and falls back to insert on ENOENT
+    void upsert(int fd, int events, void* ctx = nullptr);
+    int try_upsert(int fd, int events, void* ctx = nullptr) noexcept;
+
+    // kernel busy polling of the NAPI queues of the fds (Linux 6.9+),
+    // returns false if the kernel does not support it
+    bool set_busy_poll(uint32_t usecs, uint16_t budget = 8,
+        bool prefer = false);
+
+protected:
+    virtual int do_insert(int fd, int events, void* ctx) noexcept override;
+    virtual int do_erase(int fd) noexcept override;
+    virtual int do_modify(int fd, int events) noexcept override;
+    virtual int do_modify(int fd, int events, void* ctx) noexcept override;
+    virtual size_t do_size() const noexcept override;
+    virtual void do_clear() noexcept override;
+    virtual ssize_t do_wait(visitor_t visitor, void* arg,
+        const timespec* timeout) override;
+
 }; // class Epoll
 
 } // namespace iohub
 
+#if IOHUB_HEADER_ONLY
+#include "Epoll.cpp"
+#endif
+
 #endif // IOHUB_EPOLL_H
@@ -0,0 +1,397 @@
+// File:     src/EventLoop.cpp
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "EventLoop.h"
+
+// C
+#include <climits>
+#include <ctime>
+
+// C++
+#include <algorithm>
+
+// Linux
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+
+namespace iohub {
+
+namespace {
+inline uint64_t now_ms() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(
+        steady_clock::now().time_since_epoch()).count();
+}
+
+// same epoch as steady_clock on Linux
+inline EventLoop::time_point coarse_now() {
+    timespec time{};
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &time);
+    return EventLoop::time_point(std::chrono::duration_cast<
+        EventLoop::time_point::duration>(std::chrono::seconds(time.tv_sec)
+        + std::chrono::nanoseconds(time.tv_nsec)));
+}
+} // anonymous namespace
+
+IOHUB_INLINE
+EventLoop::EventLoop(std::unique_ptr<PollerBase> poller)
+        : poller_(std::move(poller)), timers_(now_ms()), size_(0),
+        dispatching_(false), running_(false),
+        thread_id_(std::this_thread::get_id()), executor_(nullptr),
+        now_(coarse_now()), idle_timeout_(0), signal_fd_(-1) {
+    assert_throw_iohubexcept(poller_ && poller_->is_open(),
+        "[EventLoop] The poller is not available");
+    sigemptyset(&signal_mask_);
+}
+
+IOHUB_INLINE
+EventLoop::~EventLoop() {
+    if (signal_fd_ != -1) ::close(signal_fd_);
+}
+
+IOHUB_INLINE
+void EventLoop::add(int fd, int events, handler_t handler) {
+    // exceptions
+    assert_throw_iohubexcept(fd >= 0,
+        "[EventLoop] add(): Invalid fd");
+    assert_throw_iohubexcept(handler,
+        "[EventLoop] add(): The handler is empty");
+    assert_throw_iohubexcept(!this->contains(fd),
+        "[EventLoop] add(): The fd already exists. "
+        "If you want to modify its event, "
+        "use EventLoop::modify()");
+
+    std::shared_ptr<Handler> entry(
+        new Handler{fd, events, true, false, false, 0, std::move(handler)});
+    poller_->insert(fd, this->arm_events(events), entry.get());
+    if (fd >= handler_arr_.size()) handler_arr_.resize(fd + 1);
+    handler_arr_[fd] = std::move(entry);
+    ++size_;
+    if (idle_timeout_) idle_.touch(fd, now_ms());
+}
+
+IOHUB_INLINE
+void EventLoop::modify(int fd, int events) {
+    // exceptions
+    assert_throw_iohubexcept(this->contains(fd),
+        "[EventLoop] modify(): The fd does not exist");
+
+    Handler& entry = *handler_arr_[fd];
+    // re-armed when its worker is done
+    if (entry.busy) entry.dirty = true;
+    else poller_->modify(fd, this->arm_events(events));
+    entry.events = events;
+}
+
+IOHUB_INLINE
+void EventLoop::remove(int fd) {
+    // exceptions
+    assert_throw_iohubexcept(this->contains(fd),
+        "[EventLoop] remove(): The fd does not exist");
+
+    std::shared_ptr<Handler>& entry = handler_arr_[fd];
+    entry->alive = false;
+    ready_queue_.erase(fd);
+    idle_.erase(fd);
+    // the handler may be running or have events later in this batch
+    if (dispatching_) retired_.push_back(std::move(entry));
+    else entry.reset();
+    --size_;
+    poller_->erase(fd);
+}
+
+IOHUB_INLINE
+EventLoop::handler_t EventLoop::release(int fd, int& events) {
+    // exceptions
+    assert_throw_iohubexcept(this->contains(fd),
+        "[EventLoop] release(): The fd does not exist");
+
+    // copied, the handler may be running
+    const Handler& entry = *handler_arr_[fd];
+    handler_t func = entry.func;
+    events = entry.events;
+    this->remove(fd);
+    return func;
+}
+
+IOHUB_INLINE
+bool EventLoop::contains(int fd) const noexcept {
+    return fd >= 0 && fd < handler_arr_.size() && handler_arr_[fd];
+}
+
+IOHUB_INLINE
+size_t EventLoop::size() const noexcept {
+    // return number of fds
+    return size_;
+}
+
+IOHUB_INLINE
+timer_id_t EventLoop::run_after(uint64_t delay, TimerWheel::callback_t func) {
+    // exceptions
+    assert_throw_iohubexcept(func,
+        "[EventLoop] run_after(): The callback is empty");
+
+    return timers_.add(now_ms() + delay, std::move(func));
+}
+
+IOHUB_INLINE
+bool EventLoop::cancel(timer_id_t id) noexcept {
+    return timers_.cancel(id);
+}
+
+IOHUB_INLINE
+size_t EventLoop::run_once(int timeout) {
+    // wake up for the nearest timer, or at once for the queued fds
+    uint64_t now = now_ms();
+    int timer_timeout = timers_.next_timeout(now);
+    if (timer_timeout != -1 && (timeout == -1 || timer_timeout < timeout))
+        timeout = timer_timeout;
+    if (!idle_.empty()) {
+        // and for the oldest fd to expire
+        uint64_t expiry = idle_.oldest().second + idle_timeout_;
+        int idle_timeout = expiry > now ? static_cast<int>(
+            std::min<uint64_t>(expiry - now, INT_MAX)) : 0;
+        if (timeout == -1 || idle_timeout < timeout) timeout = idle_timeout;
+    }
+    if (!ready_queue_.empty()) timeout = 0;
+
+    size_t count = 0;
+    {
+        struct Guard {
+            EventLoop& loop;
+            ~Guard() {
+                loop.dispatching_ = false;
+                loop.retired_.clear();
+            }
+        } guard{*this};
+        // posted tasks run inside visit() and may remove handlers
+        dispatching_ = true;
+
+        // queue the batch behind the requeued fds
+        bool signaled = false;
+        poller_->visit([this, &signaled](int, int events, void* ctx) {
+            if (ctx == &signal_fd_) signaled = true;
+            else if (ctx) ready_queue_.push(static_cast<Handler*>(ctx)->fd, events);
+        }, timeout);
+        now_ = coarse_now();
+        now = idle_timeout_ ? now_ms() : 0;
+        if (signaled) this->read_signals();
+
+        // one round, fds requeued in it wait for the next one
+        for (size_t round = ready_queue_.size();
+                round && !ready_queue_.empty(); --round) {
+            fd_event_t ready = ready_queue_.pop();
+            std::shared_ptr<Handler>& handler = handler_arr_[ready.first];
+            if (idle_timeout_) idle_.touch(ready.first, now);
+            if (!executor_)
+                handler->func(ready.first, ready.second);
+            else if (handler->busy)
+                handler->pending |= ready.second;
+            else
+                this->submit(handler, ready.second);
+            ++count;
+        }
+    }
+
+    // run the expired timers, then close the idle fds
+    count += timers_.advance(now_ms());
+    if (!idle_.empty()) count += this->reap_idle(now_ms());
+    return count;
+}
+
+IOHUB_INLINE
+size_t EventLoop::reap_idle(uint64_t now) {
+    if (now < idle_timeout_) return 0;
+    size_t count = 0;
+    for (int fd; (fd = idle_.pop_expired(now - idle_timeout_)) != -1; ) {
+        idle_handler_(fd);
+        ++count;
+    }
+    return count;
+}
+
+IOHUB_INLINE
+void EventLoop::set_idle_timeout(uint64_t timeout, idle_handler_t handler) {
+    // exceptions
+    assert_throw_iohubexcept(!timeout || handler,
+        "[EventLoop] set_idle_timeout(): The handler is empty");
+
+    idle_timeout_ = timeout;
+    idle_handler_ = std::move(handler);
+    idle_.clear();
+    if (!timeout) return;
+    // the registered fds start idle now
+    uint64_t now = now_ms();
+    for (size_t fd = 0; fd < handler_arr_.size(); ++fd)
+        if (handler_arr_[fd]) idle_.touch(static_cast<int>(fd), now);
+}
+
+IOHUB_INLINE
+EventLoop::time_point EventLoop::now() const noexcept {
+    return now_;
+}
+
+IOHUB_INLINE
+void EventLoop::requeue(int fd, int events) {
+    // exceptions
+    assert_throw_iohubexcept(this->contains(fd),
+        "[EventLoop] requeue(): The fd does not exist");
+    assert_throw_iohubexcept(events & IOHUB_EVENT_MASK,
+        "[EventLoop] requeue(): No events");
+
+    Handler& entry = *handler_arr_[fd];
+    if (entry.busy) entry.pending |= events & IOHUB_EVENT_MASK;
+    else ready_queue_.push(fd, events & IOHUB_EVENT_MASK);
+}
+
+IOHUB_INLINE
+void EventLoop::add_signal(int signo, signal_handler_t handler) {
+    // exceptions
+    assert_throw_iohubexcept(signo > 0 && signo < _NSIG,
+        "[EventLoop] add_signal(): Invalid signal");
+    assert_throw_iohubexcept(handler,
+        "[EventLoop] add_signal(): The handler is empty");
+
+    // block it so that it is only read from the signalfd
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, signo);
+    int ret = pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+    assert_throw_iohubexcept(ret == 0,
+        "[EventLoop] add_signal(): ", std::strerror(ret));
+
+    sigaddset(&signal_mask_, signo);
+    int fd = signalfd(signal_fd_, &signal_mask_, SFD_NONBLOCK | SFD_CLOEXEC);
+    assert_throw_iohubexcept(fd != -1,
+        "[EventLoop] add_signal(): signalfd failed, ", LAST_ERROR);
+    if (signal_fd_ == -1) {
+        // registered with a marker instead of a handler
+        signal_fd_ = fd;
+        poller_->insert(signal_fd_, IOHUB_IN, &signal_fd_);
+    }
+
+    if (signo >= signal_arr_.size()) signal_arr_.resize(signo + 1);
+    signal_arr_[signo] = std::move(handler);
+}
+
+IOHUB_INLINE
+void EventLoop::remove_signal(int signo) {
+    // exceptions
+    assert_throw_iohubexcept(signo > 0 && signo < signal_arr_.size()
+        && signal_arr_[signo],
+        "[EventLoop] remove_signal(): The signal does not exist");
+
+    signal_arr_[signo] = nullptr;
+    sigdelset(&signal_mask_, signo);
+    signalfd(signal_fd_, &signal_mask_, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, signo);
+    pthread_sigmask(SIG_UNBLOCK, &mask, nullptr);
+}
+
+IOHUB_INLINE
+void EventLoop::read_signals() {
+    signalfd_siginfo info_arr[16];
+    while (true) {
+        ssize_t ret = ::read(signal_fd_, info_arr, sizeof(info_arr));
+        if (ret <= 0) break;
+        size_t count = ret / sizeof(signalfd_siginfo);
+        for (size_t i = 0; i < count; ++i) {
+            int signo = static_cast<int>(info_arr[i].ssi_signo);
+            if (signo < signal_arr_.size() && signal_arr_[signo])
+                signal_arr_[signo](signo);
+        }
+    }
+}
+
+IOHUB_INLINE
+void EventLoop::run() {
+    thread_id_ = std::this_thread::get_id();
+    running_ = true;
+    while (running_) this->run_once();
+}
+
+IOHUB_INLINE
+void EventLoop::stop() {
+    this->post([this] { running_ = false; });
+}
+
+IOHUB_INLINE
+void EventLoop::post(task_t task) {
+    poller_->post(std::move(task));
+}
+
+IOHUB_INLINE
+bool EventLoop::in_loop_thread() const noexcept {
+    return thread_id_ == std::this_thread::get_id();
+}
+
+IOHUB_INLINE
+PollerBase& EventLoop::poller() noexcept {
+    return *poller_;
+}
+
+IOHUB_INLINE
+void EventLoop::set_executor(Executor* executor) {
+    // exceptions
+    assert_throw_iohubexcept(!size_,
+        "[EventLoop] set_executor(): The loop has fds");
+    executor_ = executor;
+}
+
+IOHUB_INLINE
+int EventLoop::arm_events(int events) const noexcept {
+    // one-shot keeps the fd quiet while its handler runs,
+    // the kernel rejects exclusive with it
+    if (!executor_) return events;
+    return (events & ~IOHUB_EXCLUSIVE) | IOHUB_ONESHOT;
+}
+
+IOHUB_INLINE
+void EventLoop::submit(const std::shared_ptr<Handler>& handler, int events) {
+    handler->busy = true;
+    std::shared_ptr<Handler> entry = handler;
+    executor_->submit([this, entry, events] {
+        entry->func(entry->fd, events);
+        // re-arm on the loop thread
+        poller_->post([this, entry] {
+            entry->busy = false;
+            if (!entry->alive) return;
+            // the fd may be closed by now, remove() follows
+            if (entry->dirty || !(entry->events & IOHUB_ONESHOT))
+                poller_->try_modify(entry->fd, this->arm_events(entry->events));
+            entry->dirty = false;
+            // ready while it ran
+            if (entry->pending) ready_queue_.push(entry->fd, entry->pending);
+            entry->pending = 0;
+        });
+    });
+}
+
+} // namespace iohub
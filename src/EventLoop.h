@@ -0,0 +1,174 @@
+// File:     src/EventLoop.h
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef IOHUB_EVENT_LOOP_H
+#define IOHUB_EVENT_LOOP_H
+
+// C++
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Linux
+#include <signal.h>
+
+// iohub
+#include "except.h"
+#include "EventQueue.h"
+#include "Executor.h"
+#include "IdleTracker.h"
+#include "PollerBase.h"
+#include "TimerWheel.h"
+
+namespace iohub {
+
+// Reactor on top of any PollerBase backend.
+// Handlers may add, modify and remove fds (including their own) while
+// being dispatched: the poller is updated at once, a removed handler is
+// not called again and is destroyed after the current batch.
+// Only post(), stop() and size() may be called from other threads.
+// With an executor, handlers run on its workers, one at a time per fd,
+// and must change the loop through post().
+class EventLoop {
+public:
+    using handler_t = std::function<void(int fd, int events)>;
+    using task_t = PollerBase::task_t;
+    using time_point = std::chrono::steady_clock::time_point;
+    using signal_handler_t = std::function<void(int signo)>;
+    using idle_handler_t = std::function<void(int fd)>;
+
+private:
+    struct Handler {
+        int fd;
+        int events;
+        bool alive;
+        bool busy;  // on an executor worker
+        bool dirty; // modified while busy
+        int pending; // ready while busy
+        handler_t func;
+    }; // registered fd, passed to the poller as ctx
+
+    std::unique_ptr<PollerBase> poller_;
+    std::vector<std::shared_ptr<Handler>> handler_arr_;
+    std::vector<std::shared_ptr<Handler>> retired_;
+    EventQueue ready_queue_;   // round-robin over the ready fds
+    TimerWheel timers_;
+    std::atomic<size_t> size_;
+    bool dispatching_;
+    bool running_;
+    std::thread::id thread_id_;
+    Executor* executor_;
+    time_point now_;
+
+    // fds by last event, reaped after idle_timeout_ ms
+    IdleTracker idle_;
+    uint64_t idle_timeout_;
+    idle_handler_t idle_handler_;
+
+    // signals read from a signalfd, handlers indexed by signo
+    int signal_fd_;
+    sigset_t signal_mask_;
+    std::vector<signal_handler_t> signal_arr_;
+
+    int arm_events(int events) const noexcept;
+    void submit(const std::shared_ptr<Handler>& handler, int events);
+    void read_signals();
+    size_t reap_idle(uint64_t now);
+
+public:
+    explicit EventLoop(std::unique_ptr<PollerBase> poller);
+    ~EventLoop();
+
+    // uncopyable
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    void add(int fd, int events, handler_t handler);
+    void modify(int fd, int events);
+    void remove(int fd);
+    bool contains(int fd) const noexcept;
+
+    // remove fd and return its handler
+    handler_t release(int fd, int& events);
+    size_t size() const noexcept;
+
+    // call func once after delay ms, the wait timeout follows the timers
+    timer_id_t run_after(uint64_t delay, TimerWheel::callback_t func);
+    bool cancel(timer_id_t id) noexcept;
+
+    // wait once and dispatch, returns the number of events and timers
+    size_t run_once(int timeout = -1);
+
+    // time of the last wakeup from a coarse monotonic clock (a few ms
+    // resolution), cheap enough to call in every handler
+    time_point now() const noexcept;
+
+    // Fairness: each fd is called at most once per round over the ready
+    // fds. The loop cannot see the handler's I/O, so the handler keeps
+    // its own budget (e.g. a few reads) and, if the fd still has data,
+    // calls requeue() to be called again after the other ready fds
+    // without waiting for a new event; needed with IOHUB_ET.
+    void requeue(int fd, int events);
+
+    // dispatch until stop()
+    void run();
+    void stop();
+
+    // Call handler on the loop thread when signo arrives. The signal is
+    // blocked in the calling thread; block it in the other threads too,
+    // e.g. before starting them, or they may take it instead.
+    void add_signal(int signo, signal_handler_t handler);
+    void remove_signal(int signo);
+
+    // Call handler for each fd without events for timeout ms, oldest
+    // first; it usually closes the connection. The wait timeout follows
+    // the oldest fd. An fd left registered is tracked again from its
+    // next event. 0 turns it off.
+    void set_idle_timeout(uint64_t timeout, idle_handler_t handler);
+
+    // run task on the loop thread after the current wait
+    void post(task_t task);
+    bool in_loop_thread() const noexcept;
+
+    PollerBase& poller() noexcept;
+
+    // run the handlers on executor, set before adding any fd.
+    // The executor must be destroyed before the loop.
+    void set_executor(Executor* executor);
+
+}; // class EventLoop
+
+} // namespace iohub
+
+#if IOHUB_HEADER_ONLY
+#include "EventLoop.cpp"
+#endif
+
+#endif // IOHUB_EVENT_LOOP_H
@@ -28,17 +28,36 @@
 
 namespace iohub {
 
-EventQueue::EventQueue() : front_(-1) {}
+IOHUB_INLINE
+EventQueue::EventQueue() : front_(-1), size_(0) {}
 
+IOHUB_INLINE
 bool EventQueue::empty() const {
     return front_ == -1;
 }
 
+IOHUB_INLINE
+size_t EventQueue::size() const {
+    return size_;
+}
+
+IOHUB_INLINE
+bool EventQueue::contains(int fd) const {
+    return fd >= 0 && fd < vec_.size() && vec_[fd].event;
+}
+
+IOHUB_INLINE
 void EventQueue::push(int fd, int event) {
     if (vec_.size() <= fd)
         vec_.resize(fd + 1);
     Node& node = vec_[fd];
+    if (node.event) {
+        // already queued
+        node.event |= event;
+        return;
+    }
     node.event = event;
+    ++size_;
     if (front_ == -1) {
         front_ = fd;
         node.prev = node.next = fd;
@@ -51,11 +70,13 @@ void EventQueue::push(int fd, int event) {
     }
 }
 
+IOHUB_INLINE
 fd_event_t EventQueue::pop() {
     if (front_ == -1) return {-1, 0};
     Node& head = vec_[front_];
     fd_event_t result = {front_, head.event};
     head.event = 0;
+    --size_;
     if (front_ == head.next) {
         front_ = -1;
     } else {
@@ -66,6 +87,7 @@ fd_event_t EventQueue::pop() {
     return result;
 }
 
+IOHUB_INLINE
 void EventQueue::erase(int fd) {
     if (front_ == -1 || fd >= vec_.size()) return;
 
@@ -75,6 +97,7 @@ void EventQueue::erase(int fd) {
     // if the fd to be erased exists
     if (cur.event) {
         cur.event = 0; // erase
+        --size_;
         if (cur.next == fd) {
             front_ = -1;
         } else {
@@ -86,9 +109,11 @@ void EventQueue::erase(int fd) {
     }
 }
 
+IOHUB_INLINE
 void EventQueue::clear() {
     front_ = -1;
+    size_ = 0;
     vec_.clear();
 }
 
-}
\ No newline at end of file
+} // namespace iohub
@@ -28,13 +28,23 @@
 #ifndef IOHUB_EVENT_QUEUE_H
 #define IOHUB_EVENT_QUEUE_H
 
+// C
+#include <cstddef>
+
+// C++
+#include <utility>
 #include <vector>
 
+// iohub
+#include "except.h"
+
 namespace iohub {
 
 // pair {fd: int, event: int}
 using fd_event_t = std::pair<int, int>;
 
+// fd-indexed circular ready list, O(1) push, pop and erase.
+// Pushing a queued fd merges the events and keeps its place.
 class EventQueue {
     struct Node {
         int next = -1;
@@ -43,12 +53,15 @@ class EventQueue {
     }; // queue node
 
     int front_;
+    size_t size_;
     std::vector<Node> vec_;
 
 public:
 
     EventQueue();
     bool empty() const;
+    size_t size() const;
+    bool contains(int fd) const;
     void push(int fd, int event);
     fd_event_t pop();
     void erase(int fd);
@@ -58,4 +71,8 @@ public:
 
 } // namespace iohub
 
+#if IOHUB_HEADER_ONLY
+#include "EventQueue.cpp"
+#endif
+
 #endif // IOHUB_EVENT_QUEUE_H
\ No newline at end of file
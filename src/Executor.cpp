@@ -0,0 +1,129 @@
+// File:     src/Executor.cpp
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "Executor.h"
+
+// C++
+#include <utility>
+
+namespace iohub {
+
+// {executor, index} of the worker running on this thread; a function
+// so that header-only builds share one per thread
+IOHUB_INLINE
+std::pair<const Executor*, size_t>& current_worker() noexcept {
+    thread_local std::pair<const Executor*, size_t> current(nullptr, 0);
+    return current;
+}
+
+IOHUB_INLINE
+Executor::Executor(size_t thread_count)
+        : queued_(0), sleeping_(0), next_(0), stopping_(false) {
+    // exceptions
+    assert_throw_iohubexcept(thread_count,
+        "[Executor] The pool needs at least one thread");
+
+    for (size_t i = 0; i < thread_count; ++i)
+        worker_arr_.emplace_back(new Worker);
+    for (size_t i = 0; i < thread_count; ++i)
+        thread_arr_.emplace_back(&Executor::work, this, i);
+}
+
+IOHUB_INLINE
+Executor::~Executor() {
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        stopping_ = true;
+    }
+    idle_cond_.notify_all();
+    for (std::thread& thread : thread_arr_)
+        thread.join();
+}
+
+IOHUB_INLINE
+void Executor::submit(task_t task) {
+    size_t count = worker_arr_.size();
+    const std::pair<const Executor*, size_t>& current = current_worker();
+    size_t index = current.first == this ? current.second
+        : next_.fetch_add(1, std::memory_order_relaxed) % count;
+    {
+        Worker& worker = *worker_arr_[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.deque.push_back(std::move(task));
+    }
+    queued_.fetch_add(1);
+    if (sleeping_.load()) {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        idle_cond_.notify_one();
+    }
+}
+
+IOHUB_INLINE
+bool Executor::take(size_t index, task_t& task) {
+    size_t count = worker_arr_.size();
+    for (size_t i = 0; i < count; ++i) {
+        Worker& worker = *worker_arr_[(index + i) % count];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.deque.empty()) continue;
+        // newest of its own, oldest of the others
+        if (i == 0) {
+            task = std::move(worker.deque.back());
+            worker.deque.pop_back();
+        } else {
+            task = std::move(worker.deque.front());
+            worker.deque.pop_front();
+        }
+        queued_.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+IOHUB_INLINE
+void Executor::work(size_t index) {
+    current_worker() = std::make_pair(this, index);
+    task_t task;
+    while (true) {
+        if (this->take(index, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(idle_mutex_);
+        ++sleeping_;
+        idle_cond_.wait(lock, [this] { return queued_.load() || stopping_; });
+        --sleeping_;
+        if (stopping_ && !queued_.load()) break;
+    }
+}
+
+IOHUB_INLINE
+size_t Executor::size() const noexcept {
+    // return number of threads
+    return thread_arr_.size();
+}
+
+} // namespace iohub
@@ -0,0 +1,93 @@
+// File:     src/Executor.h
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef IOHUB_EXECUTOR_H
+#define IOHUB_EXECUTOR_H
+
+// C++
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// iohub
+#include "except.h"
+
+namespace iohub {
+
+// Work-stealing thread pool.
+// Each worker runs its own deque newest first and steals the oldest
+// task of the others when it runs dry. Tasks must not throw.
+class Executor {
+public:
+    using task_t = std::function<void()>;
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<task_t> deque;
+    }; // per thread queue
+
+    std::vector<std::unique_ptr<Worker>> worker_arr_;
+    std::vector<std::thread> thread_arr_;
+    std::atomic<size_t> queued_;
+    std::atomic<size_t> sleeping_;
+    std::atomic<size_t> next_;
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cond_;
+    bool stopping_;
+
+    bool take(size_t index, task_t& task);
+    void work(size_t index);
+
+public:
+    explicit Executor(size_t thread_count);
+
+    // runs the queued tasks, then joins
+    ~Executor();
+
+    // uncopyable
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    // thread-safe, a worker submits to its own deque
+    void submit(task_t task);
+    size_t size() const noexcept;
+
+}; // class Executor
+
+} // namespace iohub
+
+#if IOHUB_HEADER_ONLY
+#include "Executor.cpp"
+#endif
+
+#endif // IOHUB_EXECUTOR_H
@@ -0,0 +1,116 @@
+// File:     src/IdleTracker.cpp
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "IdleTracker.h"
+
+namespace iohub {
+
+IOHUB_INLINE
+IdleTracker::IdleTracker() : front_(-1), size_(0) {}
+
+IOHUB_INLINE
+bool IdleTracker::empty() const {
+    return front_ == -1;
+}
+
+IOHUB_INLINE
+size_t IdleTracker::size() const {
+    return size_;
+}
+
+IOHUB_INLINE
+bool IdleTracker::contains(int fd) const {
+    return fd >= 0 && fd < vec_.size() && vec_[fd].linked;
+}
+
+IOHUB_INLINE
+void IdleTracker::unlink(int fd) {
+    Node& cur = vec_[fd];
+    cur.linked = false;
+    --size_;
+    if (cur.next == fd) {
+        front_ = -1;
+    } else {
+        if (fd == front_)
+            front_ = cur.next;
+        vec_[cur.next].prev = cur.prev;
+        vec_[cur.prev].next = cur.next;
+    }
+}
+
+IOHUB_INLINE
+void IdleTracker::touch(int fd, uint64_t now) {
+    if (vec_.size() <= fd)
+        vec_.resize(fd + 1);
+    Node& node = vec_[fd];
+    node.last = now;
+    if (node.linked) {
+        // already the newest
+        if (vec_[front_].prev == fd) return;
+        this->unlink(fd);
+    }
+    node.linked = true;
+    ++size_;
+    if (front_ == -1) {
+        front_ = fd;
+        node.prev = node.next = fd;
+    } else {
+        // the tail is the node before the front
+        Node& head = vec_[front_];
+        node.next = front_;
+        node.prev = head.prev;
+        vec_[head.prev].next = fd;
+        head.prev = fd;
+    }
+}
+
+IOHUB_INLINE
+void IdleTracker::erase(int fd) {
+    if (this->contains(fd)) this->unlink(fd);
+}
+
+IOHUB_INLINE
+void IdleTracker::clear() {
+    front_ = -1;
+    size_ = 0;
+    vec_.clear();
+}
+
+IOHUB_INLINE
+std::pair<int, uint64_t> IdleTracker::oldest() const {
+    if (front_ == -1) return {-1, 0};
+    return {front_, vec_[front_].last};
+}
+
+IOHUB_INLINE
+int IdleTracker::pop_expired(uint64_t deadline) {
+    if (front_ == -1 || vec_[front_].last > deadline) return -1;
+    int fd = front_;
+    this->unlink(fd);
+    return fd;
+}
+
+} // namespace iohub
@@ -0,0 +1,88 @@
+// File:     src/IdleTracker.h
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef IOHUB_IDLE_TRACKER_H
+#define IOHUB_IDLE_TRACKER_H
+
+// C
+#include <cstddef>
+#include <cstdint>
+
+// C++
+#include <utility>
+#include <vector>
+
+// iohub
+#include "except.h"
+
+namespace iohub {
+
+// fd-indexed LRU of the last activity of each fd, the same circular
+// list as EventQueue: O(1) touch, erase and pop of the oldest fd, no
+// allocation once the node array covers the fds. Times are in ms.
+class IdleTracker {
+    struct Node {
+        int next = -1;
+        int prev = -1;
+        bool linked = false;
+        uint64_t last = 0;  // time of the last touch
+    }; // list node
+
+    int front_;
+    size_t size_;
+    std::vector<Node> vec_;
+
+    void unlink(int fd);
+
+public:
+
+    IdleTracker();
+    bool empty() const;
+    size_t size() const;
+    bool contains(int fd) const;
+
+    // record activity of fd at now, it becomes the newest
+    void touch(int fd, uint64_t now);
+    void erase(int fd);
+    void clear();
+
+    // {fd, last touch} of the least recently touched fd, {-1, 0} if empty
+    std::pair<int, uint64_t> oldest() const;
+
+    // pop the oldest fd if it was last touched at or before deadline,
+    // -1 otherwise
+    int pop_expired(uint64_t deadline);
+
+}; // class IdleTracker
+
+} // namespace iohub
+
+#if IOHUB_HEADER_ONLY
+#include "IdleTracker.cpp"
+#endif
+
+#endif // IOHUB_IDLE_TRACKER_H
@@ -0,0 +1,466 @@
+// File:     src/IoUring.cpp
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "IoUring.h"
+
+// C
+#include <cstring>
+#include <ctime>
+
+// C++
+#include <new>
+
+// Linux
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+namespace iohub {
+
+namespace {
+const unsigned IO_URING_SQ_ENTRIES = 256;
+const unsigned IO_URING_CQ_ENTRIES = 4096;
+
+// user_data of POLL_REMOVE requests, their completions are dropped
+const uint64_t IO_URING_REMOVE_TAG = ~uint64_t(0);
+
+// user_data of POLL_ADD requests: {gen: 32, fd: 32}
+inline uint64_t make_tag(int fd, uint32_t gen) {
+    return static_cast<uint64_t>(gen) << 32 | static_cast<uint32_t>(fd);
+}
+
+inline int io_uring_setup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+inline int io_uring_enter(int ring_fd, unsigned to_submit,
+        unsigned min_complete, unsigned flags, void* arg, size_t argsz) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd,
+        to_submit, min_complete, flags, arg, argsz));
+}
+
+inline void* map_ring(int ring_fd, size_t size, off_t offset) {
+    void* ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+inline timespec deadline_after(const timespec& timeout) {
+    timespec now;
+    ::clock_gettime(CLOCK_MONOTONIC, &now);
+    now.tv_sec += timeout.tv_sec;
+    now.tv_nsec += timeout.tv_nsec;
+    if (now.tv_nsec >= 1000000000) {
+        ++now.tv_sec;
+        now.tv_nsec -= 1000000000;
+    }
+    return now;
+}
+
+// false if deadline has passed
+inline bool time_left(const timespec& deadline, timespec& left) {
+    timespec now;
+    ::clock_gettime(CLOCK_MONOTONIC, &now);
+    left.tv_sec = deadline.tv_sec - now.tv_sec;
+    left.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+    if (left.tv_nsec < 0) {
+        --left.tv_sec;
+        left.tv_nsec += 1000000000;
+    }
+    return left.tv_sec > 0 || (left.tv_sec == 0 && left.tv_nsec > 0);
+}
+
+template <class T>
+inline T* ring_at(void* ring, uint32_t offset) {
+    return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+} // anonymous namespace
+
+IOHUB_INLINE
+IoUring::IoUring() : ring_fd_(-1), size_(0),
+        sq_head_(nullptr), sq_tail_(nullptr), sq_mask_(0), sq_entries_(0),
+        sqe_arr_(nullptr), cq_head_(nullptr), cq_tail_(nullptr), cq_mask_(0),
+        cqe_arr_(nullptr), sq_ring_(nullptr), cq_ring_(nullptr),
+        sq_ring_size_(0), cq_ring_size_(0), sqe_arr_size_(0) {
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = IO_URING_CQ_ENTRIES;
+    ring_fd_ = io_uring_setup(IO_URING_SQ_ENTRIES, &params);
+    assert_throw_iohubexcept(ring_fd_ >= 0,
+        "[IoUring] io_uring setup failed, ", LAST_ERROR);
+
+    // timeouts are passed by IORING_ENTER_EXT_ARG (Linux 5.11)
+    bool supported = params.features & IORING_FEAT_EXT_ARG;
+    if (!supported) this->close();
+    assert_throw_iohubexcept(supported,
+        "[IoUring] io_uring setup failed, the kernel is too old");
+
+    // map the rings
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes
+        + params.cq_entries * sizeof(io_uring_cqe);
+    sqe_arr_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (cq_ring_size_ > sq_ring_size_) sq_ring_size_ = cq_ring_size_;
+        cq_ring_size_ = sq_ring_size_;
+        sq_ring_ = cq_ring_ = map_ring(ring_fd_,
+            sq_ring_size_, IORING_OFF_SQ_RING);
+    } else {
+        sq_ring_ = map_ring(ring_fd_, sq_ring_size_, IORING_OFF_SQ_RING);
+        cq_ring_ = map_ring(ring_fd_, cq_ring_size_, IORING_OFF_CQ_RING);
+    }
+    sqe_arr_ = static_cast<io_uring_sqe*>(
+        map_ring(ring_fd_, sqe_arr_size_, IORING_OFF_SQES));
+    bool mapped = sq_ring_ && cq_ring_ && sqe_arr_;
+    const char* error = LAST_ERROR;
+    if (!mapped) this->close();
+    assert_throw_iohubexcept(mapped, "[IoUring] io_uring mmap failed, ", error);
+
+    sq_head_ = ring_at<unsigned>(sq_ring_, params.sq_off.head);
+    sq_tail_ = ring_at<unsigned>(sq_ring_, params.sq_off.tail);
+    sq_mask_ = *ring_at<unsigned>(sq_ring_, params.sq_off.ring_mask);
+    sq_entries_ = *ring_at<unsigned>(sq_ring_, params.sq_off.ring_entries);
+    cq_head_ = ring_at<unsigned>(cq_ring_, params.cq_off.head);
+    cq_tail_ = ring_at<unsigned>(cq_ring_, params.cq_off.tail);
+    cq_mask_ = *ring_at<unsigned>(cq_ring_, params.cq_off.ring_mask);
+    cqe_arr_ = ring_at<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+
+    // slot i of the submission queue always holds sqe i
+    unsigned* sq_array = ring_at<unsigned>(sq_ring_, params.sq_off.array);
+    for (unsigned i = 0; i < sq_entries_; ++i) sq_array[i] = i;
+}
+
+IOHUB_INLINE
+IoUring::~IoUring() {
+    this->close();
+}
+
+IOHUB_INLINE
+void IoUring::mark(int fd) noexcept {
+    // changes_ has room for every fd of entry_arr_, see do_insert()
+    Entry& entry = entry_arr_[fd];
+    if (!entry.dirty) {
+        entry.dirty = true;
+        changes_.push_back(fd);
+    }
+}
+
+IOHUB_INLINE
+io_uring_sqe* IoUring::next_sqe() noexcept {
+    unsigned tail = *sq_tail_;
+    if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_) {
+        // the submission queue is full, submit it first
+        int ret = this->enter(0, nullptr);
+        if (ret < 0 && errno != EBUSY) return nullptr;
+        // EBUSY: the completion queue is full and the kernel took none
+        if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE)
+                == sq_entries_) {
+            errno = EBUSY;
+            return nullptr;
+        }
+    }
+    io_uring_sqe* sqe = &sqe_arr_[tail & sq_mask_];
+    std::memset(sqe, 0, sizeof(io_uring_sqe));
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+IOHUB_INLINE
+int IoUring::flush() noexcept {
+    size_t i = 0;
+    for (; i < changes_.size(); ++i) {
+        const int fd = changes_[i];
+        Entry& entry = entry_arr_[fd];
+        bool wanted = entry.events && entry.armed;
+
+        // cancel the outdated request, its completions are dropped by gen
+        if (entry.active && (!wanted || entry.replace)) {
+            io_uring_sqe* sqe = this->next_sqe();
+            if (!sqe) break;
+            sqe->opcode = IORING_OP_POLL_REMOVE;
+            sqe->fd = -1;
+            sqe->addr = make_tag(fd, entry.gen);
+            sqe->user_data = IO_URING_REMOVE_TAG;
+            entry.active = false;
+            ++entry.gen;
+        }
+        entry.replace = false;
+
+        // multishot for edge-triggered fds, single-shot otherwise
+        if (wanted && !entry.active) {
+            io_uring_sqe* sqe = this->next_sqe();
+            if (!sqe) break;
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = fd;
+            sqe->poll32_events = static_cast<uint32_t>(
+                entry.events & IOHUB_EVENT_MASK);
+            if ((entry.events & IOHUB_ET) && !(entry.events & IOHUB_ONESHOT))
+                sqe->len = IORING_POLL_ADD_MULTI;
+            sqe->user_data = make_tag(fd, entry.gen);
+            entry.active = true;
+        }
+        entry.dirty = false;
+    }
+    if (i == changes_.size()) {
+        changes_.clear();
+        return 0;
+    }
+    // submission failed, keep the rest for the next wait()
+    int err = errno;
+    changes_.erase(changes_.begin(), changes_.begin() + i);
+    return -err;
+}
+
+IOHUB_INLINE
+int IoUring::enter(unsigned min_complete, const timespec* timeout) noexcept {
+    io_uring_getevents_arg arg{};
+    __kernel_timespec ts{};
+    if (timeout) {
+        ts.tv_sec = timeout->tv_sec;
+        ts.tv_nsec = timeout->tv_nsec;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+    unsigned to_submit = *sq_tail_
+        - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    return io_uring_enter(ring_fd_, to_submit, min_complete,
+        IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+IOHUB_INLINE
+size_t IoUring::reap(visitor_t visitor, void* arg) {
+    size_t result = 0;
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        const io_uring_cqe& cqe = cqe_arr_[head & cq_mask_];
+        if (cqe.user_data == IO_URING_REMOVE_TAG) continue;
+
+        // drop completions of outdated requests
+        int fd = static_cast<int>(cqe.user_data & 0xffffffff);
+        uint32_t gen = static_cast<uint32_t>(cqe.user_data >> 32);
+        if (fd >= entry_arr_.size()) continue;
+        Entry& entry = entry_arr_[fd];
+        if (!entry.active || entry.gen != gen) continue;
+
+        // the request is finished, re-arm it in the next batch
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            entry.active = false;
+            if (entry.events & IOHUB_ONESHOT) entry.armed = false;
+            else this->mark(fd);
+        }
+
+        // erased or modified since the request was submitted
+        int revents = cqe.res & ((entry.events & IOHUB_EVENT_MASK)
+            | POLLERR | POLLHUP);
+        if (!entry.events) continue;
+
+        if (cqe.res < 0) {
+            // the fd cannot be polled, report it as poll() does
+            entry.armed = false;
+            revents = POLLNVAL;
+        }
+        if (revents) {
+            ++result;
+            visitor(arg, fd, revents, entry.ctx);
+        }
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return result;
+}
+
+IOHUB_INLINE
+int IoUring::do_insert(int fd, int events, void* ctx) noexcept {
+    // errors
+    if (ring_fd_ == -1) return this->fail(EBADF, "IoUring is closed");
+    if (fd < 0) return this->fail(EBADF, "Invalid fd");
+    if (!(events & IOHUB_EVENT_MASK)) return this->fail(EINVAL,
+        "Events is empty. "
+        "If you want to remove fd from io_uring, "
+        "use IoUring::erase()");
+    if (events & ~(IOHUB_EVENT_MASK | IOHUB_MODE_MASK)) return this->fail(
+        EINVAL, "Events is not supported. "
+        "IoUring supports only IOHUB_IN, IOHUB_OUT, IOHUB_PRI "
+        "and the trigger modes");
+    if (events & IOHUB_EXCLUSIVE) return this->fail(EINVAL,
+        "IOHUB_EXCLUSIVE is not supported by IoUring");
+    if (fd >= entry_arr_.size()) {
+        try {
+            entry_arr_.resize(fd + 1);
+            changes_.reserve(entry_arr_.size());
+        } catch (const std::bad_alloc&) {
+            return this->fail(ENOMEM);
+        }
+    }
+    Entry& entry = entry_arr_[fd];
+    if (entry.events) return this->fail(EEXIST,
+        "The fd already exists. "
+        "If you want to modify its event, "
+        "use IoUring::modify()");
+
+    // submitted by the next wait()
+    entry.events = events;
+    entry.ctx = ctx;
+    entry.armed = entry.replace = true;
+    this->mark(fd);
+    ++size_;
+    return 0;
+}
+
+IOHUB_INLINE
+int IoUring::do_erase(int fd) noexcept {
+    // errors
+    if (ring_fd_ == -1) return this->fail(EBADF, "IoUring is closed");
+    if (fd < 0) return this->fail(EBADF, "Invalid fd");
+    if (fd >= entry_arr_.size() || !entry_arr_[fd].events)
+        return this->fail(ENOENT, "The fd does not exist");
+
+    // submitted by the next wait()
+    Entry& entry = entry_arr_[fd];
+    entry.events = 0;
+    entry.ctx = nullptr;
+    entry.armed = false;
+    this->mark(fd);
+    --size_;
+    return 0;
+}
+
+IOHUB_INLINE
+int IoUring::do_modify(int fd, int events) noexcept {
+    // keep the context
+    bool exists = fd >= 0 && fd < entry_arr_.size() && entry_arr_[fd].events;
+    return this->do_modify(fd, events,
+        exists ? entry_arr_[fd].ctx : nullptr);
+}
+
+IOHUB_INLINE
+int IoUring::do_modify(int fd, int events, void* ctx) noexcept {
+    // errors
+    if (ring_fd_ == -1) return this->fail(EBADF, "IoUring is closed");
+    if (fd < 0) return this->fail(EBADF, "Invalid fd");
+    if (!(events & IOHUB_EVENT_MASK)) return this->fail(EINVAL,
+        "Events is empty. "
+        "If you want to remove fd from io_uring, "
+        "use IoUring::erase()");
+    if (events & ~(IOHUB_EVENT_MASK | IOHUB_MODE_MASK)) return this->fail(
+        EINVAL, "Events is not supported. "
+        "IoUring supports only IOHUB_IN, IOHUB_OUT, IOHUB_PRI "
+        "and the trigger modes");
+    if (events & IOHUB_EXCLUSIVE) return this->fail(EINVAL,
+        "IOHUB_EXCLUSIVE is not supported by IoUring");
+    if (fd >= entry_arr_.size() || !entry_arr_[fd].events)
+        return this->fail(ENOENT, "The fd does not exist");
+
+    // submitted by the next wait(), re-arms a one-shot fd
+    Entry& entry = entry_arr_[fd];
+    entry.events = events;
+    entry.ctx = ctx;
+    entry.armed = entry.replace = true;
+    this->mark(fd);
+    return 0;
+}
+
+IOHUB_INLINE
+size_t IoUring::do_size() const noexcept {
+    // return number of fds
+    return size_;
+}
+
+IOHUB_INLINE
+void IoUring::do_clear() noexcept {
+    for (size_t fd = 0; fd < entry_arr_.size(); ++fd) {
+        Entry& entry = entry_arr_[fd];
+        if (entry.events) {
+            entry.events = 0;
+            entry.armed = false;
+            this->mark(static_cast<int>(fd));
+        }
+    }
+    size_ = 0;
+}
+
+IOHUB_INLINE
+ssize_t IoUring::do_wait(visitor_t visitor, void* arg,
+        const timespec* timeout) {
+    // errors
+    if (ring_fd_ == -1) return this->fail(EBADF, "IoUring is closed");
+    if (!size_) return this->fail(ENOENT, "IoUring is empty");
+
+    bool block = !timeout || timeout->tv_sec || timeout->tv_nsec;
+    timespec deadline{}, left{};
+    if (timeout && block) deadline = deadline_after(*timeout);
+    size_t result = 0;
+    for (;;) {
+        // submit the changes and wait in one syscall; on EBUSY the rest
+        // is submitted once the completions below are reaped
+        int ret = this->flush();
+        if (ret < 0 && ret != -EBUSY) return this->fail(-ret);
+        bool ready = *cq_head_ != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        bool pending = *sq_tail_ != __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (!ready || pending) {
+            ret = ready ? this->enter(0, nullptr)
+                : this->enter(block ? 1 : 0, timeout);
+            if (ret < 0 && (errno == ETIME || errno == EINTR)) return 0;
+            if (ret < 0 && errno != EBUSY) return this->fail(errno);
+        }
+        result = this->reap(visitor, arg);
+        if (result || !block) break;
+        // only outdated completions, wait for the rest of the timeout
+        if (timeout) {
+            if (!time_left(deadline, left)) break;
+            timeout = &left;
+        }
+    }
+    return static_cast<ssize_t>(result);
+}
+
+IOHUB_INLINE
+const char* IoUring::name() const noexcept {
+    return "IoUring";
+}
+
+IOHUB_INLINE
+bool IoUring::is_open() const noexcept {
+    return ring_fd_ != -1;
+}
+
+IOHUB_INLINE
+void IoUring::close() noexcept {
+    if (ring_fd_ != -1) {
+        this->clear();
+        if (sqe_arr_) ::munmap(sqe_arr_, sqe_arr_size_);
+        if (cq_ring_ && cq_ring_ != sq_ring_) ::munmap(cq_ring_, cq_ring_size_);
+        if (sq_ring_) ::munmap(sq_ring_, sq_ring_size_);
+        sqe_arr_ = nullptr;
+        sq_ring_ = cq_ring_ = nullptr;
+        ::close(ring_fd_);
+        ring_fd_ = -1;
+        entry_arr_.clear();
+        changes_.clear();
+    }
+}
+
+} // namespace iohub
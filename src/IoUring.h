@@ -0,0 +1,120 @@
+// File:     src/IoUring.h
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef IOHUB_IO_URING_H
+#define IOHUB_IO_URING_H
+
+// C
+#include <cstdint>
+
+// C++
+#include <vector>
+
+// Linux
+#include <unistd.h>
+
+// iohub
+#include "except.h"
+#include "PollerBase.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace iohub {
+
+// Readiness through io_uring poll requests (Linux 5.13+).
+// insert(), modify() and erase() only record the change; all changes
+// are submitted in one io_uring_enter() by the next wait().
+// Edge-triggered fds use multishot polls, level-triggered fds use
+// single-shot polls that are re-armed in the next batch.
+// IOHUB_EXCLUSIVE is rejected with EINVAL.
+class IoUring : public PollerBase {
+    struct Entry {
+        int events = 0;         // registered events, 0 if not registered
+        uint32_t gen = 0;       // tag of the poll request in the kernel
+        bool active = false;    // a poll request is in the kernel
+        bool armed = false;     // a poll request is wanted
+        bool replace = false;   // the request in the kernel is outdated
+        bool dirty = false;     // queued in changes_
+        void* ctx = nullptr;
+    }; // per fd entry
+
+    int ring_fd_;
+    size_t size_;
+    std::vector<Entry> entry_arr_;
+    std::vector<int> changes_;
+
+    // submission queue
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned sq_mask_, sq_entries_;
+    io_uring_sqe* sqe_arr_;
+
+    // completion queue
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned cq_mask_;
+    io_uring_cqe* cqe_arr_;
+
+    // mapped memory
+    void* sq_ring_;
+    void* cq_ring_;
+    size_t sq_ring_size_, cq_ring_size_, sqe_arr_size_;
+
+    void mark(int fd) noexcept;
+    int flush() noexcept;
+    io_uring_sqe* next_sqe() noexcept;
+    int enter(unsigned min_complete, const timespec* timeout) noexcept;
+    size_t reap(visitor_t visitor, void* arg);
+
+public:
+    IoUring();
+    virtual ~IoUring() override;
+
+    virtual const char* name() const noexcept override;
+    virtual bool is_open() const noexcept override;
+    virtual void close() noexcept override;
+
+protected:
+    virtual int do_insert(int fd, int events, void* ctx) noexcept override;
+    virtual int do_erase(int fd) noexcept override;
+    virtual int do_modify(int fd, int events) noexcept override;
+    virtual int do_modify(int fd, int events, void* ctx) noexcept override;
+    virtual size_t do_size() const noexcept override;
+    virtual void do_clear() noexcept override;
+    virtual ssize_t do_wait(visitor_t visitor, void* arg,
+        const timespec* timeout) override;
+
+}; // class IoUring
+
+} // namespace iohub
+
+#if IOHUB_HEADER_ONLY
+#include "IoUring.cpp"
+#endif
+
+#endif // IOHUB_IO_URING_H
@@ -26,41 +26,71 @@
 
 #include "Poll.h"
 
+// C++
+#include <new>
+#include <utility>
+
 namespace iohub {
 
-Poll::Poll() : is_open_(true) {}
+IOHUB_INLINE
+Poll::Poll() : is_open_(true), adaptive_(false) {}
+
+IOHUB_INLINE
+void Poll::swap_entries(size_t i, size_t j) noexcept {
+    std::swap(pollfd_arr_[i], pollfd_arr_[j]);
+    std::vector<bool>::swap(oneshot_arr_[i], oneshot_arr_[j]);
+    std::swap(ctx_arr_[i], ctx_arr_[j]);
+    // disarmed fds are stored as ~fd
+    int fd_i = pollfd_arr_[i].fd, fd_j = pollfd_arr_[j].fd;
+    fd_map_[fd_i < 0 ? ~fd_i : fd_i] = i;
+    fd_map_[fd_j < 0 ? ~fd_j : fd_j] = j;
+}
 
-void Poll::insert(int fd, int events) {
-    // exceptions
-    assert_throw_iohubexcept(is_open_,
-        "[Poll] insert(): Poll is closed");
-    assert_throw_iohubexcept(fd >= 0,
-        "[Poll] insert(): Invalid fd");
-    assert_throw_iohubexcept(events,
-        "[Poll] insert(): Events is empty. "
+IOHUB_INLINE
+int Poll::do_insert(int fd, int events, void* ctx) noexcept {
+    // errors
+    if (!is_open_) return this->fail(EBADF, "Poll is closed");
+    if (fd < 0) return this->fail(EBADF, "Invalid fd");
+    if (!(events & IOHUB_EVENT_MASK)) return this->fail(EINVAL,
+        "Events is empty. "
         "If you want to remove fd from poll, "
         "use Poll::erase()");
-    if (fd >= fd_map_.size()) fd_map_.resize(fd + 1, -1);
-    assert_throw_iohubexcept(fd_map_[fd] == -1,
-        "[Poll] insert(): The fd already exists. "
+    if (events & ~(IOHUB_EVENT_MASK | IOHUB_MODE_MASK)) return this->fail(
+        EINVAL, "Events is not supported. "
+        "Poll supports only IOHUB_IN, IOHUB_OUT, IOHUB_PRI "
+        "and the trigger modes");
+    if (fd < fd_map_.size() && fd_map_[fd] != -1) return this->fail(EEXIST,
+        "The fd already exists. "
         "If you want to modify its event, "
         "use Poll::modify()");
 
+    try {
+        if (fd >= fd_map_.size()) fd_map_.resize(fd + 1, -1);
+        pollfd_arr_.reserve(pollfd_arr_.size() + 1);
+        oneshot_arr_.reserve(oneshot_arr_.size() + 1);
+        ctx_arr_.reserve(ctx_arr_.size() + 1);
+    } catch (const std::bad_alloc&) {
+        return this->fail(ENOMEM);
+    }
+
     // insert to fd map
     fd_map_[fd] = pollfd_arr_.size();
 
     // insert to pollfd list
-    pollfd_arr_.push_back({fd, static_cast<short>(events), short(0)});
+    pollfd_arr_.push_back({fd,
+        static_cast<short>(events & IOHUB_EVENT_MASK), short(0)});
+    oneshot_arr_.push_back(events & IOHUB_ONESHOT);
+    ctx_arr_.push_back(ctx);
+    return 0;
 }
 
-void Poll::erase(int fd) {
-    // exceptions
-    assert_throw_iohubexcept(is_open_,
-        "[Poll] erase(): Poll is closed");
-    assert_throw_iohubexcept(fd >= 0,
-        "[Poll] erase(): Invalid fd");
-    assert_throw_iohubexcept(fd < fd_map_.size() && fd_map_[fd] != -1,
-        "[Poll] erase(): The fd does not exist");
+IOHUB_INLINE
+int Poll::do_erase(int fd) noexcept {
+    // errors
+    if (!is_open_) return this->fail(EBADF, "Poll is closed");
+    if (fd < 0) return this->fail(EBADF, "Invalid fd");
+    if (fd >= fd_map_.size() || fd_map_[fd] == -1)
+        return this->fail(ENOENT, "The fd does not exist");
 
     // remove fd from the fd map
     size_t index = fd_map_[fd];
@@ -69,71 +99,112 @@ void Poll::erase(int fd) {
     // remove fd from the pollfd list
     if (index != pollfd_arr_.size() - 1) {
         pollfd_arr_[index] = std::move(pollfd_arr_.back());
+        oneshot_arr_[index] = oneshot_arr_.back();
+        ctx_arr_[index] = ctx_arr_.back();
+        // the moved fd may be disarmed (stored as ~fd)
+        int moved = pollfd_arr_[index].fd;
+        fd_map_[moved < 0 ? ~moved : moved] = index;
     }
     pollfd_arr_.pop_back();
+    oneshot_arr_.pop_back();
+    ctx_arr_.pop_back();
+    return 0;
 }
 
-void Poll::modify(int fd, int events) {
-    // exceptions
-    assert_throw_iohubexcept(is_open_,
-        "[Poll] modify(): Poll is closed");
-    assert_throw_iohubexcept(fd >= 0,
-        "[Poll] modify(): Invalid fd");
-    assert_throw_iohubexcept(events,
-        "[Poll] modify(): Events is empty. "
+IOHUB_INLINE
+int Poll::do_modify(int fd, int events) noexcept {
+    // keep the context
+    bool exists = fd >= 0 && fd < fd_map_.size() && fd_map_[fd] != -1;
+    return this->do_modify(fd, events,
+        exists ? ctx_arr_[fd_map_[fd]] : nullptr);
+}
+
+IOHUB_INLINE
+int Poll::do_modify(int fd, int events, void* ctx) noexcept {
+    // errors
+    if (!is_open_) return this->fail(EBADF, "Poll is closed");
+    if (fd < 0) return this->fail(EBADF, "Invalid fd");
+    if (!(events & IOHUB_EVENT_MASK)) return this->fail(EINVAL,
+        "Events is empty. "
         "If you want to remove fd from poll, "
         "use Poll::erase()");
-    assert_throw_iohubexcept(fd < fd_map_.size() && fd_map_[fd] != -1,
-        "[Poll] modify(): The fd does not exist");
-
-    // update the events
-    pollfd_arr_[fd_map_[fd]].events = events;
+    if (events & ~(IOHUB_EVENT_MASK | IOHUB_MODE_MASK)) return this->fail(
+        EINVAL, "Events is not supported. "
+        "Poll supports only IOHUB_IN, IOHUB_OUT, IOHUB_PRI "
+        "and the trigger modes");
+    if (fd >= fd_map_.size() || fd_map_[fd] == -1)
+        return this->fail(ENOENT, "The fd does not exist");
+
+    // update the events, re-arm if it was disarmed
+    size_t index = fd_map_[fd];
+    pollfd_arr_[index].fd = fd;
+    pollfd_arr_[index].events = static_cast<short>(events & IOHUB_EVENT_MASK);
+    oneshot_arr_[index] = events & IOHUB_ONESHOT;
+    ctx_arr_[index] = ctx;
+    return 0;
 }
 
-size_t Poll::size() const noexcept {
+IOHUB_INLINE
+size_t Poll::do_size() const noexcept {
     // return number of fds
     return pollfd_arr_.size();
 }
 
-void Poll::clear() noexcept {
+IOHUB_INLINE
+void Poll::do_clear() noexcept {
     pollfd_arr_.clear();
+    oneshot_arr_.clear();
+    ctx_arr_.clear();
     fd_map_.clear();
 }
 
-size_t Poll::wait(std::vector<fd_event_t>& fdevt_arr, int timeout) {
-    // exceptions
-    assert_throw_iohubexcept(is_open_,
-        "[Poll] wait(): Poll is closed");
-    assert_throw_iohubexcept(!pollfd_arr_.empty(),
-        "[Poll] wait(): Poll is empty");
+IOHUB_INLINE
+ssize_t Poll::do_wait(visitor_t visitor, void* arg,
+        const timespec* timeout) {
+    // errors
+    if (!is_open_) return this->fail(EBADF, "Poll is closed");
+    if (pollfd_arr_.empty()) return this->fail(ENOENT, "Poll is empty");
 
-    // call poll()
-    int ret = poll(pollfd_arr_.data(), pollfd_arr_.size(), timeout);
+    // call ppoll()
+    int ret = ppoll(pollfd_arr_.data(), pollfd_arr_.size(), timeout, nullptr);
 
-    if (ret == 0) {
-        // non-blocking
-        fdevt_arr.clear();
-        return 0;
-    }
-    assert_throw_iohubexcept(ret > 0, "[Poll] wait(): ", LAST_ERROR);
+    // non-blocking or interrupted by a signal
+    if (ret == 0 || (ret == -1 && errno == EINTR)) return 0;
+    if (ret < 0) return this->fail(errno);
 
     // iterate over the result set
-    fdevt_arr.resize(ret);
     for (size_t i = 0, cnt = 0; cnt < ret; ++i) {
         pollfd& fd_revent = pollfd_arr_[i];
         if (fd_revent.revents) {
-            fdevt_arr[cnt++] = {fd_revent.fd, fd_revent.revents};
+            visitor(arg, fd_revent.fd, fd_revent.revents, ctx_arr_[i]);
             fd_revent.revents = 0;
+            // one-shot: poll() ignores negative fds until modify()
+            if (oneshot_arr_[i]) fd_revent.fd = ~fd_revent.fd;
+            // adaptive: entries before cnt were scanned and idle
+            if (adaptive_ && i != cnt) this->swap_entries(i, cnt);
+            ++cnt;
         }
     }
 
     return ret;
 }
 
+IOHUB_INLINE
+const char* Poll::name() const noexcept {
+    return "Poll";
+}
+
+IOHUB_INLINE
 bool Poll::is_open() const noexcept {
     return is_open_;
 }
 
+IOHUB_INLINE
+void Poll::set_adaptive(bool adaptive) noexcept {
+    adaptive_ = adaptive;
+}
+
+IOHUB_INLINE
 void Poll::close() noexcept {
     if (is_open_) {
         this->clear();
@@ -47,26 +47,41 @@ namespace iohub {
 class Poll : public PollerBase {
     std::vector<size_t> fd_map_;
     std::vector<pollfd> pollfd_arr_;
+    std::vector<bool> oneshot_arr_;
+    std::vector<void*> ctx_arr_;
     bool is_open_;
+    bool adaptive_;
+
+    void swap_entries(size_t i, size_t j) noexcept;
 
 public:
     Poll();
     virtual ~Poll() override = default;
 
-    virtual void insert(int fd, int events) override;
-    virtual void erase(int fd) override;
-    virtual void modify(int fd, int events) override;
-    virtual size_t size() const noexcept override;
-    virtual void clear() noexcept override;
-
-    virtual size_t wait(std::vector<fd_event_t>& fdevt_arr,
-        int timeout = -1) override;
-
+    virtual const char* name() const noexcept override;
     virtual bool is_open() const noexcept override;
     virtual void close() noexcept override;
 
+    // move the ready fds to the front after each wait, so busy fds among
+    // many idle ones are found (by the kernel and the scan) first
+    void set_adaptive(bool adaptive) noexcept;
+
+protected:
+    virtual int do_insert(int fd, int events, void* ctx) noexcept override;
+    virtual int do_erase(int fd) noexcept override;
+    virtual int do_modify(int fd, int events) noexcept override;
+    virtual int do_modify(int fd, int events, void* ctx) noexcept override;
+    virtual size_t do_size() const noexcept override;
+    virtual void do_clear() noexcept override;
+    virtual ssize_t do_wait(visitor_t visitor, void* arg,
+        const timespec* timeout) override;
+
 }; // class Poll
 
 } // namespace iohub
 
+#if IOHUB_HEADER_ONLY
+#include "Poll.cpp"
+#endif
+
 #endif // IOHUB_POLL_H
@@ -0,0 +1,180 @@
+// File:     src/Poller.h
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef IOHUB_POLLER_H
+#define IOHUB_POLLER_H
+
+// C++
+#include <chrono>
+#include <type_traits>
+#include <vector>
+
+// iohub
+#include "PollerBase.h"
+
+namespace iohub {
+
+// Backend bound at compile time: Poller<Epoll> is an Epoll whose
+// operations call the backend directly instead of through the vtable,
+// so they can be inlined into the caller. The semantics are those of
+// PollerBase, and a Poller<Backend> still works as a PollerBase& for
+// code that picks the backend at runtime.
+template <class Backend>
+class Poller final : public Backend {
+    static_assert(std::is_base_of<PollerBase, Backend>::value,
+        "Poller: Backend must derive from PollerBase");
+
+    using visitor_t = PollerBase::visitor_t;
+    using Collector = PollerBase::Collector;
+
+    struct Direct {
+        Poller* poller;
+        ssize_t operator()(visitor_t visitor, void* arg,
+                const timespec* timeout) const {
+            return poller->Backend::do_wait(visitor, arg, timeout);
+        }
+    }; // do_wait() of Backend
+
+public:
+    using Backend::Backend;
+
+    void insert(int fd, int events, void* ctx = nullptr) {
+        this->check(this->try_insert(fd, events, ctx), "insert()");
+    }
+
+    void erase(int fd) {
+        this->check(this->try_erase(fd), "erase()");
+    }
+
+    void modify(int fd, int events) {
+        this->check(this->try_modify(fd, events), "modify()");
+    }
+
+    void modify(int fd, int events, void* ctx) {
+        this->check(this->try_modify(fd, events, ctx), "modify()");
+    }
+
+    int try_insert(int fd, int events, void* ctx = nullptr) noexcept {
+        return this->ctl(IOHUB_CTL_INSERT, [&] {
+            return this->Backend::do_insert(fd, events, ctx);
+        });
+    }
+
+    int try_erase(int fd) noexcept {
+        return this->ctl(IOHUB_CTL_ERASE, [&] {
+            return this->Backend::do_erase(fd);
+        });
+    }
+
+    int try_modify(int fd, int events) noexcept {
+        return this->ctl(IOHUB_CTL_MODIFY, [&] {
+            return this->Backend::do_modify(fd, events);
+        });
+    }
+
+    int try_modify(int fd, int events, void* ctx) noexcept {
+        return this->ctl(IOHUB_CTL_MODIFY, [&] {
+            return this->Backend::do_modify(fd, events, ctx);
+        });
+    }
+
+    size_t wait(std::vector<fd_event_t>& fdevt_arr, int timeout = -1) {
+        return this->check(this->try_wait(fdevt_arr, timeout), "wait()");
+    }
+
+    template <class Rep, class Period>
+    size_t wait_for(std::vector<fd_event_t>& fdevt_arr,
+            const std::chrono::duration<Rep, Period>& timeout) {
+        return this->check(this->try_wait_for(fdevt_arr, timeout), "wait()");
+    }
+
+    template <class Clock, class Duration>
+    size_t wait_until(std::vector<fd_event_t>& fdevt_arr,
+            const std::chrono::time_point<Clock, Duration>& deadline) {
+        return this->wait_for(fdevt_arr, deadline - Clock::now());
+    }
+
+    template <class Visitor>
+    size_t visit(Visitor&& visitor, int timeout = -1) {
+        return this->check(this->try_visit(visitor, timeout), "wait()");
+    }
+
+    template <class Visitor, class Rep, class Period>
+    size_t visit_for(Visitor&& visitor,
+            const std::chrono::duration<Rep, Period>& timeout) {
+        return this->check(this->try_visit_for(visitor, timeout), "wait()");
+    }
+
+    template <class Visitor, class Clock, class Duration>
+    size_t visit_until(Visitor&& visitor,
+            const std::chrono::time_point<Clock, Duration>& deadline) {
+        return this->visit_for(visitor, deadline - Clock::now());
+    }
+
+    ssize_t try_wait(std::vector<fd_event_t>& fdevt_arr, int timeout = -1) {
+        fdevt_arr.clear();
+        return this->try_visit(Collector{fdevt_arr}, timeout);
+    }
+
+    template <class Rep, class Period>
+    ssize_t try_wait_for(std::vector<fd_event_t>& fdevt_arr,
+            const std::chrono::duration<Rep, Period>& timeout) {
+        fdevt_arr.clear();
+        return this->try_visit_for(Collector{fdevt_arr}, timeout);
+    }
+
+    template <class Clock, class Duration>
+    ssize_t try_wait_until(std::vector<fd_event_t>& fdevt_arr,
+            const std::chrono::time_point<Clock, Duration>& deadline) {
+        return this->try_wait_for(fdevt_arr, deadline - Clock::now());
+    }
+
+    template <class Visitor>
+    ssize_t try_visit(Visitor&& visitor, int timeout = -1) {
+        timespec time = PollerBase::to_timespec(timeout);
+        return this->visit_ts(Direct{this}, visitor,
+            timeout < 0 ? nullptr : &time);
+    }
+
+    template <class Visitor, class Rep, class Period>
+    ssize_t try_visit_for(Visitor&& visitor,
+            const std::chrono::duration<Rep, Period>& timeout) {
+        timespec time = PollerBase::to_timespec(timeout);
+        return this->visit_ts(Direct{this}, visitor, &time);
+    }
+
+    template <class Visitor, class Clock, class Duration>
+    ssize_t try_visit_until(Visitor&& visitor,
+            const std::chrono::time_point<Clock, Duration>& deadline) {
+        return this->try_visit_for(visitor, deadline - Clock::now());
+    }
+
+}; // class Poller
+
+} // namespace iohub
+
+#endif // IOHUB_POLLER_H
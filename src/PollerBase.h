@@ -28,10 +28,25 @@
 #ifndef IOHUB_POLLER_BASE_H
 #define IOHUB_POLLER_BASE_H
 
+// C
+#include <cstdint>
+#include <ctime>
+
 // C++
+#include <chrono>
+#include <functional>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+// Linux
+#include <sys/types.h>
+
+// iohub
+#include "except.h"
+#include "TaskQueue.h"
+#include "Waker.h"
+
 namespace iohub {
 
 // pair {fd: int, event: int}
@@ -41,10 +56,112 @@ enum Event {
     IOHUB_IN  = 0x01,
     IOHUB_PRI = 0x02,
     IOHUB_OUT = 0x04,
+
+    // trigger modes (same bits as epoll), or-ed into the events.
+    // Select and Poll report ET and EXCLUSIVE fds level-triggered,
+    // which is always safe for code written for edge-triggered.
+    IOHUB_EXCLUSIVE = 0x10000000, // wake one of the pollers sharing the fd
+    IOHUB_ONESHOT   = 0x40000000, // disarm after one event, re-arm by modify()
+    IOHUB_ET        = 0x80000000, // edge-triggered
 }; // Event
 
+const int IOHUB_EVENT_MASK = IOHUB_IN | IOHUB_PRI | IOHUB_OUT;
+const int IOHUB_MODE_MASK = static_cast<int>(
+    IOHUB_EXCLUSIVE | IOHUB_ONESHOT | IOHUB_ET);
+
+// counters of the spin-then-block wait mode
+struct spin_stats_t {
+    uint64_t polls = 0;     // zero-timeout polls while spinning
+    uint64_t hits = 0;      // waits that found events while spinning
+    uint64_t misses = 0;    // waits that blocked after the spin budget
+    uint64_t wasted_ns = 0; // time spun by the misses
+}; // struct spin_stats_t
+
+// per-poller counters, off by default and switched on by
+// set_metrics(); building with IOHUB_METRICS=0 compiles them out
+#ifndef IOHUB_METRICS
+#define IOHUB_METRICS 1
+#endif
+
+enum CtlOp {
+    IOHUB_CTL_INSERT,
+    IOHUB_CTL_ERASE,
+    IOHUB_CTL_MODIFY,
+    IOHUB_CTL_COUNT,
+}; // CtlOp
+
+struct poller_metrics_t {
+    // bucket 0 counts zero, bucket i counts [2^(i-1), 2^i), the last
+    // bucket also counts everything above it
+    static const size_t EVENT_BUCKETS = 16;  // events per wait
+    static const size_t BLOCK_BUCKETS = 24;  // us blocked per wait
+
+    uint64_t waits = 0;         // wait(), visit() and their variants
+    uint64_t empty_waits = 0;   // waits that returned no events
+    uint64_t wakeups = 0;       // waits woken by wakeup() or post()
+    uint64_t events = 0;        // events returned
+    uint64_t refills = 0;       // full result buffers read again
+    uint64_t blocked_ns = 0;    // until the first event or the timeout
+    uint64_t processing_ns = 0; // visiting the events and between waits
+    uint64_t ctl[IOHUB_CTL_COUNT] = {}; // by CtlOp
+    uint64_t events_hist[EVENT_BUCKETS] = {};
+    uint64_t blocked_hist[BLOCK_BUCKETS] = {};
+}; // struct poller_metrics_t
+
 class PollerBase {
+
+    // posted tasks, the waker fd is registered by the first wait
+    TaskQueue task_queue_;
+    Waker waker_;
+    bool waker_added_ = false;
+
+    // spin-then-block
+    uint32_t spin_us_ = 0;
+    spin_stats_t spin_stats_;
+
+    // metrics, last_return_ns_ is 0 until the first timed wait
+    bool metrics_on_ = false;
+    poller_metrics_t metrics_;
+    uint64_t last_return_ns_ = 0;
+
+    // reason of the last failure, nullptr for strerror()
+    const char* error_detail_ = nullptr;
+
+    template <class Visitor>
+    struct Filter {
+        Visitor& visitor;
+        void* waker;
+        size_t woken;
+        bool timed;             // metrics on
+        uint64_t first_ns;      // first event, 0 if none yet
+    }; // hides the waker from the visitor
+
+    // visitor(fd, events, ctx) if it takes the context
+    template <class Visitor>
+    static auto call_visitor(Visitor& visitor, int fd, int events,
+            void* ctx, int) -> decltype(visitor(fd, events, ctx), void()) {
+        visitor(fd, events, ctx);
+    }
+
+    template <class Visitor>
+    static void call_visitor(Visitor& visitor, int fd, int events,
+            void*, long) {
+        visitor(fd, events);
+    }
+
+    template <class Visitor>
+    static void invoke_visitor(void* arg, int fd, int events, void* ctx) {
+        Filter<Visitor>& filter = *static_cast<Filter<Visitor>*>(arg);
+        if (filter.timed && !filter.first_ns) filter.first_ns = now_ns();
+        if (ctx == filter.waker) ++filter.woken;
+        else call_visitor(filter.visitor, fd, events, ctx, 0);
+    }
+
 public:
+    // called by do_wait() for each ready fd
+    using visitor_t = void (*)(void* arg, int fd, int events, void* ctx);
+    using task_t = TaskQueue::task_t;
+
     // ctor & dtor
     PollerBase() = default;
     virtual ~PollerBase() = default;
@@ -53,18 +170,378 @@ public:
     PollerBase(const PollerBase&) = delete;
     PollerBase& operator=(const PollerBase&) = delete;
 
-    virtual void insert(int fd, int events) = 0;
-    virtual void erase(int fd) = 0;
-    virtual void modify(int fd, int events) = 0;
-    virtual size_t size() const noexcept = 0;
-    virtual void clear() noexcept = 0;
+    // name of the backend in error messages
+    virtual const char* name() const noexcept = 0;
+
+    // ctx is an opaque pointer handed back with each event of the fd,
+    // modify() without ctx keeps the current one.
+    // These throw IOHubExcept, the try_ variants below return the error.
+    void insert(int fd, int events, void* ctx = nullptr) {
+        this->check(this->try_insert(fd, events, ctx), "insert()");
+    }
+
+    void erase(int fd) {
+        this->check(this->try_erase(fd), "erase()");
+    }
+
+    void modify(int fd, int events) {
+        this->check(this->try_modify(fd, events), "modify()");
+    }
+
+    void modify(int fd, int events, void* ctx) {
+        this->check(this->try_modify(fd, events, ctx), "modify()");
+    }
+
+    // non-throwing: 0 or -errno, e.g. -EEXIST, -ENOENT or the kernel's
+    // error; error_detail() then tells the reason if there is one
+    int try_insert(int fd, int events, void* ctx = nullptr) noexcept {
+        return this->ctl(IOHUB_CTL_INSERT, [&] {
+            return this->do_insert(fd, events, ctx);
+        });
+    }
+
+    int try_erase(int fd) noexcept {
+        return this->ctl(IOHUB_CTL_ERASE, [&] {
+            return this->do_erase(fd);
+        });
+    }
+
+    int try_modify(int fd, int events) noexcept {
+        return this->ctl(IOHUB_CTL_MODIFY, [&] {
+            return this->do_modify(fd, events);
+        });
+    }
+
+    int try_modify(int fd, int events, void* ctx) noexcept {
+        return this->ctl(IOHUB_CTL_MODIFY, [&] {
+            return this->do_modify(fd, events, ctx);
+        });
+    }
+
+    const char* error_detail() const noexcept {
+        return error_detail_;
+    }
+
+    size_t size() const noexcept {
+        return this->do_size() - waker_added_;
+    }
+
+    void clear() noexcept {
+        this->do_clear();
+        waker_added_ = false;
+    }
+
+    // thread-safe: run task on the waiting thread after its current or
+    // next wait, waking it up if it is blocked
+    void post(task_t task) {
+        task_queue_.push(std::move(task));
+        waker_.wake();
+    }
+
+    // thread-safe: make the current or next wait return
+    void wakeup() noexcept {
+        waker_.wake();
+    }
+
+    // copy the ready fds to fdevt_arr, timeout in ms, -1 blocks
+    size_t wait(std::vector<fd_event_t>& fdevt_arr, int timeout = -1) {
+        return this->check(this->try_wait(fdevt_arr, timeout), "wait()");
+    }
+
+    // nanosecond timeouts and deadlines
+    template <class Rep, class Period>
+    size_t wait_for(std::vector<fd_event_t>& fdevt_arr,
+            const std::chrono::duration<Rep, Period>& timeout) {
+        return this->check(this->try_wait_for(fdevt_arr, timeout), "wait()");
+    }
+
+    template <class Clock, class Duration>
+    size_t wait_until(std::vector<fd_event_t>& fdevt_arr,
+            const std::chrono::time_point<Clock, Duration>& deadline) {
+        return this->wait_for(fdevt_arr, deadline - Clock::now());
+    }
 
-    virtual size_t wait(std::vector<fd_event_t>& fdevt_arr,
-        int timeout = -1) = 0;
+    // call visitor(fd, events) or visitor(fd, events, ctx) for each ready
+    // fd straight from the backend's result buffer, then run the posted
+    // tasks if woken. Do not modify the poller inside the visitor.
+    template <class Visitor>
+    size_t visit(Visitor&& visitor, int timeout = -1) {
+        return this->check(this->try_visit(visitor, timeout), "wait()");
+    }
+
+    template <class Visitor, class Rep, class Period>
+    size_t visit_for(Visitor&& visitor,
+            const std::chrono::duration<Rep, Period>& timeout) {
+        return this->check(this->try_visit_for(visitor, timeout), "wait()");
+    }
+
+    template <class Visitor, class Clock, class Duration>
+    size_t visit_until(Visitor&& visitor,
+            const std::chrono::time_point<Clock, Duration>& deadline) {
+        return this->visit_for(visitor, deadline - Clock::now());
+    }
+
+    // non-throwing waits: the number of events or -errno. Only the
+    // visitor, the posted tasks and fdevt_arr's allocation can throw.
+    ssize_t try_wait(std::vector<fd_event_t>& fdevt_arr, int timeout = -1) {
+        fdevt_arr.clear();
+        return this->try_visit(Collector{fdevt_arr}, timeout);
+    }
+
+    template <class Rep, class Period>
+    ssize_t try_wait_for(std::vector<fd_event_t>& fdevt_arr,
+            const std::chrono::duration<Rep, Period>& timeout) {
+        fdevt_arr.clear();
+        return this->try_visit_for(Collector{fdevt_arr}, timeout);
+    }
+
+    template <class Clock, class Duration>
+    ssize_t try_wait_until(std::vector<fd_event_t>& fdevt_arr,
+            const std::chrono::time_point<Clock, Duration>& deadline) {
+        return this->try_wait_for(fdevt_arr, deadline - Clock::now());
+    }
+
+    template <class Visitor>
+    ssize_t try_visit(Visitor&& visitor, int timeout = -1) {
+        timespec time = to_timespec(timeout);
+        return this->visit_ts(Dispatch{this}, visitor,
+            timeout < 0 ? nullptr : &time);
+    }
+
+    template <class Visitor, class Rep, class Period>
+    ssize_t try_visit_for(Visitor&& visitor,
+            const std::chrono::duration<Rep, Period>& timeout) {
+        timespec time = to_timespec(timeout);
+        return this->visit_ts(Dispatch{this}, visitor, &time);
+    }
+
+    template <class Visitor, class Clock, class Duration>
+    ssize_t try_visit_until(Visitor&& visitor,
+            const std::chrono::time_point<Clock, Duration>& deadline) {
+        return this->try_visit_for(visitor, deadline - Clock::now());
+    }
+
+    // spin with zero-timeout polls for up to spin_us before blocking,
+    // 0 turns it off
+    void set_spin(uint32_t spin_us) noexcept {
+        spin_us_ = spin_us;
+    }
+
+    uint32_t spin() const noexcept {
+        return spin_us_;
+    }
+
+    const spin_stats_t& spin_stats() const noexcept {
+        return spin_stats_;
+    }
+
+    void reset_spin_stats() noexcept {
+        spin_stats_ = spin_stats_t();
+    }
+
+    // count waits, events and ctl operations, see poller_metrics_t
+    void set_metrics(bool on) noexcept {
+        metrics_on_ = IOHUB_METRICS && on;
+        last_return_ns_ = 0;
+    }
+
+    bool metrics_enabled() const noexcept {
+        return metrics_on_;
+    }
+
+    // snapshot for export, not thread-safe against the waiting thread
+    poller_metrics_t metrics() const noexcept {
+        return metrics_;
+    }
+
+    void reset_metrics() noexcept {
+        metrics_ = poller_metrics_t();
+    }
 
     virtual bool is_open() const noexcept = 0;
     virtual void close() noexcept = 0;
 
+protected:
+    // 0 or -errno, see fail()
+    virtual int do_insert(int fd, int events, void* ctx) noexcept = 0;
+    virtual int do_erase(int fd) noexcept = 0;
+    virtual int do_modify(int fd, int events) noexcept = 0;
+    virtual int do_modify(int fd, int events, void* ctx) noexcept = 0;
+    virtual size_t do_size() const noexcept = 0;
+    virtual void do_clear() noexcept = 0;
+    // the number of events or -errno, timeout nullptr blocks
+    virtual ssize_t do_wait(visitor_t visitor, void* arg,
+        const timespec* timeout) = 0;
+
+    // do_wait() of another poller, for pollers built on other pollers
+    static ssize_t wait_on(PollerBase& poller, visitor_t visitor, void* arg,
+            const timespec* timeout) {
+        return poller.do_wait(visitor, arg, timeout);
+    }
+
+    // return -err, detail replaces strerror(err) in the exception
+    int fail(int err, const char* detail = nullptr) noexcept {
+        error_detail_ = detail;
+        return -err;
+    }
+
+    struct Collector {
+        std::vector<fd_event_t>& fdevt_arr;
+        void operator()(int fd, int events) {
+            fdevt_arr.emplace_back(fd, events);
+        }
+    }; // visitor of wait()
+
+    // ms, -1 blocks (nullptr)
+    static timespec to_timespec(int ms) noexcept {
+        return ms < 0 ? timespec{0, 0}
+            : timespec{ms / 1000, ms % 1000 * 1000000L};
+    }
+
+    template <class Rep, class Period>
+    static timespec to_timespec(
+            const std::chrono::duration<Rep, Period>& timeout) noexcept {
+        using namespace std::chrono;
+        int64_t ns = duration_cast<nanoseconds>(timeout).count();
+        if (ns < 0) ns = 0;
+        return timespec{static_cast<time_t>(ns / 1000000000),
+            static_cast<long>(ns % 1000000000)};
+    }
+
+    // the API below is shared with Poller<Backend>, which passes op and
+    // wait calling its backend directly instead of through the vtable
+
+    // op() is a do_ call
+    template <class Op>
+    int ctl(CtlOp type, Op op) noexcept {
+        error_detail_ = nullptr;
+        int ret = op();
+        if (!ret) this->count_ctl(type);
+        return ret;
+    }
+
+    // throw for a failed try_ call
+    ssize_t check(ssize_t ret, const char* func) const {
+        if (ret < 0) throw_except_<IOHubExcept>("[", this->name(), "] ",
+            func, ": ", error_detail_ ? error_detail_
+            : std::strerror(static_cast<int>(-ret)));
+        return ret;
+    }
+
+    // wait(visitor, arg, timeout) is a do_wait() call, timeout nullptr
+    // blocks
+    template <class Wait, class Visitor>
+    ssize_t visit_ts(Wait wait, Visitor& visitor, const timespec* timeout) {
+        error_detail_ = nullptr;
+        if (!waker_added_) {
+            int ret = this->try_insert(waker_.fd(), IOHUB_IN, &waker_);
+            if (ret < 0) return ret;
+            waker_added_ = true;
+        }
+        Filter<Visitor> filter{visitor, &waker_, 0, metrics_on_, 0};
+        visitor_t trampoline = &PollerBase::invoke_visitor<Visitor>;
+        bool poll_only = timeout && !timeout->tv_sec && !timeout->tv_nsec;
+        const uint64_t start_ns = filter.timed ? now_ns() : 0;
+        ssize_t count = spin_us_ && !poll_only
+            ? this->spin_wait(wait, trampoline, &filter, timeout)
+            : wait(trampoline, &filter, timeout);
+        if (filter.timed && count >= 0) this->record_wait(filter.first_ns,
+            start_ns, count - filter.woken, filter.woken);
+        if (!filter.woken) return count;
+        waker_.reset();
+        task_queue_.run();
+        return count < 0 ? count : count - filter.woken;
+    }
+
+    // metric hooks
+    void count_ctl(CtlOp op) noexcept {
+#if IOHUB_METRICS
+        if (metrics_on_) ++metrics_.ctl[op];
+#else
+        (void)op;
+#endif
+    }
+
+    void count_refill() noexcept {
+#if IOHUB_METRICS
+        if (metrics_on_) ++metrics_.refills;
+#endif
+    }
+
+private:
+    struct Dispatch {
+        PollerBase* poller;
+        ssize_t operator()(visitor_t visitor, void* arg,
+                const timespec* timeout) const {
+            return poller->do_wait(visitor, arg, timeout);
+        }
+    }; // do_wait() through the vtable
+
+    static uint64_t now_ns() noexcept {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // 0 for 0, else the bit width of value, at most buckets - 1
+    static size_t bucket(uint64_t value, size_t buckets) noexcept {
+        size_t i = value ? 64 - __builtin_clzll(value) : 0;
+        return i < buckets ? i : buckets - 1;
+    }
+
+    void record_wait(uint64_t first_ns, uint64_t start_ns, size_t events,
+            size_t woken) noexcept {
+        const uint64_t end_ns = now_ns();
+        const uint64_t block_end_ns = first_ns ? first_ns : end_ns;
+        const uint64_t blocked_ns = block_end_ns - start_ns;
+        poller_metrics_t& m = metrics_;
+        ++m.waits;
+        m.events += events;
+        if (!events) ++m.empty_waits;
+        if (woken) ++m.wakeups;
+        m.blocked_ns += blocked_ns;
+        m.processing_ns += end_ns - block_end_ns;
+        if (last_return_ns_) m.processing_ns += start_ns - last_return_ns_;
+        last_return_ns_ = end_ns;
+        ++m.events_hist[bucket(events, poller_metrics_t::EVENT_BUCKETS)];
+        ++m.blocked_hist[bucket(blocked_ns / 1000,
+            poller_metrics_t::BLOCK_BUCKETS)];
+    }
+
+    // zero-timeout polls for the spin budget, then block
+    template <class Wait>
+    ssize_t spin_wait(Wait& wait, visitor_t visitor, void* arg,
+            const timespec* timeout) {
+        using clock = std::chrono::steady_clock;
+        const clock::time_point start = clock::now();
+        const int64_t limit_ns = timeout ? timeout->tv_sec * 1000000000LL
+            + timeout->tv_nsec : -1;
+        int64_t budget_ns = int64_t(spin_us_) * 1000;
+        if (limit_ns != -1 && limit_ns < budget_ns) budget_ns = limit_ns;
+
+        const timespec zero{0, 0};
+        int64_t spent_ns = 0;
+        do {
+            ++spin_stats_.polls;
+            ssize_t count = wait(visitor, arg, &zero);
+            if (count < 0) return count;
+            if (count) {
+                ++spin_stats_.hits;
+                return count;
+            }
+            spent_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock::now() - start).count();
+        } while (spent_ns < budget_ns);
+
+        // block for the rest of the timeout
+        ++spin_stats_.misses;
+        spin_stats_.wasted_ns += spent_ns;
+        if (limit_ns == -1) return wait(visitor, arg, nullptr);
+        int64_t rest_ns = limit_ns > spent_ns ? limit_ns - spent_ns : 0;
+        timespec rest{static_cast<time_t>(rest_ns / 1000000000),
+            static_cast<long>(rest_ns % 1000000000)};
+        return wait(visitor, arg, &rest);
+    }
+
 }; // class PollerBase
 
 } // namespace iohub
@@ -0,0 +1,359 @@
+// File:     src/ReactorPool.cpp
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ReactorPool.h"
+
+// C++
+#include <future>
+
+// Linux
+#include <pthread.h>
+#include <sched.h>
+
+namespace iohub {
+
+IOHUB_INLINE
+ReactorPool::ReactorPool(size_t loop_count, factory_t factory, Policy policy)
+        : load_arr_(loop_count), policy_(policy), next_(0) {
+    // exceptions
+    assert_throw_iohubexcept(loop_count,
+        "[ReactorPool] The pool needs at least one loop");
+    assert_throw_iohubexcept(factory,
+        "[ReactorPool] The poller factory is empty");
+
+    for (size_t i = 0; i < loop_count; ++i)
+        loop_arr_.emplace_back(new EventLoop(factory()));
+}
+
+IOHUB_INLINE
+ReactorPool::~ReactorPool() {
+    this->stop();
+}
+
+IOHUB_INLINE
+size_t ReactorPool::pick(int fd) {
+    // with mutex_ held
+    size_t count = loop_arr_.size();
+    switch (policy_) {
+    case LEAST_LOADED: {
+        size_t index = 0;
+        for (size_t i = 1; i < count; ++i)
+            if (load_arr_[i] < load_arr_[index]) index = i;
+        return index;
+    }
+    case HASH:
+        return static_cast<uint32_t>(fd) * 2654435761u % count;
+    default:
+        return next_++ % count;
+    }
+}
+
+IOHUB_INLINE
+bool ReactorPool::in_thread(size_t index) const noexcept {
+    return index < thread_arr_.size()
+        && thread_arr_[index].get_id() == std::this_thread::get_id();
+}
+
+IOHUB_INLINE
+bool ReactorPool::in_pool() const noexcept {
+    for (const std::thread& thread : thread_arr_)
+        if (thread.get_id() == std::this_thread::get_id()) return true;
+    return false;
+}
+
+IOHUB_INLINE
+void ReactorPool::report(int fd, const IOHubExcept& e) {
+    error_handler_t handler;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        handler = error_handler_;
+    }
+    if (handler) handler(fd, e);
+}
+
+IOHUB_INLINE
+void ReactorPool::start(const std::vector<int>& cpu_arr) {
+    // exceptions
+    assert_throw_iohubexcept(thread_arr_.empty(),
+        "[ReactorPool] start(): The pool is already started");
+
+    for (size_t i = 0; i < loop_arr_.size(); ++i) {
+        EventLoop* loop = loop_arr_[i].get();
+        thread_arr_.emplace_back([loop] { loop->run(); });
+        if (i < cpu_arr.size() && cpu_arr[i] >= 0) {
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(cpu_arr[i], &cpu_set);
+            int ret = pthread_setaffinity_np(thread_arr_.back().native_handle(),
+                sizeof(cpu_set), &cpu_set);
+            assert_throw_iohubexcept(ret == 0,
+                "[ReactorPool] start(): Set CPU affinity failed, ",
+                std::strerror(ret));
+        }
+    }
+}
+
+IOHUB_INLINE
+void ReactorPool::stop() {
+    for (size_t i = 0; i < thread_arr_.size(); ++i)
+        loop_arr_[i]->stop();
+    for (std::thread& thread : thread_arr_)
+        thread.join();
+    thread_arr_.clear();
+}
+
+IOHUB_INLINE
+size_t ReactorPool::add(int fd, int events, EventLoop::handler_t handler) {
+    // exceptions
+    assert_throw_iohubexcept(fd >= 0,
+        "[ReactorPool] add(): Invalid fd");
+    assert_throw_iohubexcept(handler,
+        "[ReactorPool] add(): The handler is empty");
+
+    size_t index = 0;
+    uint32_t gen = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (fd >= owner_arr_.size()) owner_arr_.resize(fd + 1);
+        Owner& owner = owner_arr_[fd];
+        assert_throw_iohubexcept(owner.index == -1,
+            "[ReactorPool] add(): The fd already exists");
+        index = this->pick(fd);
+        owner.index = static_cast<int>(index);
+        gen = owner.gen;
+        ++load_arr_[index];
+    }
+
+    // on the loop thread at once, like modify() and remove()
+    EventLoop* loop = loop_arr_[index].get();
+    if (this->in_thread(index)) {
+        try {
+            loop->add(fd, events, std::move(handler));
+        } catch (const IOHubExcept&) {
+            this->unassign(fd, index, gen);
+            throw;
+        }
+        return index;
+    }
+    loop->post([this, loop, fd, events, handler, index, gen] {
+        try {
+            loop->add(fd, events, handler);
+        } catch (const IOHubExcept& e) {
+            this->unassign(fd, index, gen);
+            this->report(fd, e);
+        }
+    });
+    return index;
+}
+
+IOHUB_INLINE
+void ReactorPool::unassign(int fd, size_t index, uint32_t gen) {
+    // undo a failed add() unless the fd was removed or moved meanwhile
+    std::lock_guard<std::mutex> lock(mutex_);
+    Owner& owner = owner_arr_[fd];
+    if (owner.gen == gen && owner.index == index) {
+        owner.index = -1;
+        --load_arr_[index];
+    }
+}
+
+IOHUB_INLINE
+void ReactorPool::modify(int fd, int events) {
+    size_t index = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        assert_throw_iohubexcept(fd >= 0 && fd < owner_arr_.size()
+            && owner_arr_[fd].index != -1,
+            "[ReactorPool] modify(): The fd does not exist");
+        Owner& owner = owner_arr_[fd];
+        // not in the target loop yet, its add() takes the events
+        if (owner.moving) {
+            owner.events = events;
+            return;
+        }
+        index = owner.index;
+    }
+
+    EventLoop* loop = loop_arr_[index].get();
+    if (this->in_thread(index)) {
+        loop->modify(fd, events);
+        return;
+    }
+    loop->post([this, loop, fd, events] {
+        try {
+            loop->modify(fd, events);
+        } catch (const IOHubExcept& e) {
+            this->report(fd, e);
+        }
+    });
+}
+
+IOHUB_INLINE
+size_t ReactorPool::detach(int fd, bool blocking, bool& moving) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // exceptions
+    assert_throw_iohubexcept(fd >= 0 && fd < owner_arr_.size()
+        && owner_arr_[fd].index != -1,
+        "[ReactorPool] remove(): The fd does not exist");
+    Owner& owner = owner_arr_[fd];
+    // a moving fd is dropped by the source loop, the target will not add it
+    size_t index = owner.moving ? owner.from : owner.index;
+    // two loops waiting on each other would never wake up
+    assert_throw_iohubexcept(!blocking || this->in_thread(index)
+        || !this->in_pool(),
+        "[ReactorPool] remove(): Called from another loop of the pool, "
+        "use remove(fd, done)");
+
+    --load_arr_[owner.index];
+    owner.index = -1;
+    ++owner.gen;
+    moving = owner.moving;
+    owner.moving = false;
+    return index;
+}
+
+IOHUB_INLINE
+void ReactorPool::drop(size_t index, int fd, bool moving, task_t done) {
+    // a moving fd may be released already, then its pending release is
+    // a no-op as gen changed
+    EventLoop* loop = loop_arr_[index].get();
+    auto task = [loop, fd, moving, done] {
+        if (!moving || loop->contains(fd)) loop->remove(fd);
+        if (done) done();
+    };
+    if (!thread_arr_.empty() && this->in_thread(index)) task();
+    else loop->post(task);
+}
+
+IOHUB_INLINE
+void ReactorPool::remove(int fd) {
+    bool moving = false;
+    size_t index = this->detach(fd, true, moving);
+    if (thread_arr_.empty() || this->in_thread(index)) {
+        this->drop(index, fd, moving, nullptr);
+        return;
+    }
+
+    // wait for the loop, the caller may close the fd next
+    std::promise<void> done;
+    std::future<void> result = done.get_future();
+    this->drop(index, fd, moving, [&done] { done.set_value(); });
+    result.get();
+}
+
+IOHUB_INLINE
+void ReactorPool::remove(int fd, task_t done) {
+    bool moving = false;
+    size_t index = this->detach(fd, false, moving);
+    this->drop(index, fd, moving, std::move(done));
+}
+
+IOHUB_INLINE
+void ReactorPool::move(int fd, size_t index) {
+    // exceptions
+    assert_throw_iohubexcept(index < loop_arr_.size(),
+        "[ReactorPool] move(): Invalid loop index");
+
+    size_t from = 0;
+    uint32_t gen = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        assert_throw_iohubexcept(fd >= 0 && fd < owner_arr_.size()
+            && owner_arr_[fd].index != -1,
+            "[ReactorPool] move(): The fd does not exist");
+        Owner& owner = owner_arr_[fd];
+        assert_throw_iohubexcept(!owner.moving,
+            "[ReactorPool] move(): The fd is being moved");
+        from = owner.index;
+        if (from == index) return;
+        owner.index = static_cast<int>(index);
+        owner.from = static_cast<int>(from);
+        owner.moving = true;
+        owner.events = -1;
+        gen = ++owner.gen;
+        --load_arr_[from];
+        ++load_arr_[index];
+    }
+
+    // release on the source loop, then add on the target loop
+    EventLoop* src = loop_arr_[from].get();
+    EventLoop* dst = loop_arr_[index].get();
+    src->post([this, src, dst, fd, index, gen] {
+        int events = 0;
+        EventLoop::handler_t handler;
+        try {
+            handler = src->release(fd, events);
+        } catch (const IOHubExcept& e) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                Owner& owner = owner_arr_[fd];
+                if (owner.gen != gen) return;  // removed meanwhile
+                --load_arr_[owner.index];
+                owner.index = -1;
+                owner.moving = false;
+            }
+            this->report(fd, e);
+            return;
+        }
+        dst->post([this, dst, fd, events, handler, index, gen]() mutable {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                Owner& owner = owner_arr_[fd];
+                if (owner.gen != gen) return;  // removed meanwhile
+                owner.moving = false;
+                // modified while moving
+                if (owner.events != -1) events = owner.events;
+            }
+            try {
+                dst->add(fd, events, handler);
+            } catch (const IOHubExcept& e) {
+                this->report(fd, e);
+            }
+        });
+    });
+}
+
+IOHUB_INLINE
+void ReactorPool::set_error_handler(error_handler_t handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    error_handler_ = std::move(handler);
+}
+
+IOHUB_INLINE
+EventLoop& ReactorPool::loop(size_t index) {
+    // exceptions
+    assert_throw_iohubexcept(index < loop_arr_.size(),
+        "[ReactorPool] loop(): Invalid loop index");
+    return *loop_arr_[index];
+}
+
+IOHUB_INLINE
+size_t ReactorPool::size() const noexcept {
+    // return number of loops
+    return loop_arr_.size();
+}
+
+} // namespace iohub
@@ -0,0 +1,127 @@
+// File:     src/ReactorPool.h
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef IOHUB_REACTOR_POOL_H
+#define IOHUB_REACTOR_POOL_H
+
+// C
+#include <cstdint>
+
+// C++
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// iohub
+#include "except.h"
+#include "EventLoop.h"
+
+namespace iohub {
+
+// N event loops, one thread and one poller each.
+// add(), modify() and move() are posted to the owning loop; failures
+// there go to the error handler. On the owning loop's thread, add(),
+// modify() and remove() run at once and throw. A modify() while the fd
+// is moved applies to the target loop.
+// Once started, remove(fd) returns after the loop has dropped the fd,
+// also while it is being moved, so the fd may be closed right after it.
+// It throws on the thread of another loop of the pool, which could
+// deadlock; remove(fd, done) does not wait and runs done on the owning
+// loop once the fd is dropped.
+class ReactorPool {
+public:
+    enum Policy {
+        ROUND_ROBIN,
+        LEAST_LOADED,   // fewest fds
+        HASH,           // by fd
+    }; // how add() picks a loop
+
+    using factory_t = std::function<std::unique_ptr<PollerBase>()>;
+    using error_handler_t = std::function<void(int fd, const IOHubExcept&)>;
+    using task_t = EventLoop::task_t;
+
+private:
+    struct Owner {
+        int index = -1;         // loop of the fd, -1 if none
+        uint32_t gen = 0;       // bumped by move() and remove()
+        int from = -1;          // source loop while moving
+        int events = -1;        // set by modify() while moving, -1 if not
+        bool moving = false;    // between the two loops
+    }; // per fd assignment
+
+    std::vector<std::unique_ptr<EventLoop>> loop_arr_;
+    std::vector<std::thread> thread_arr_;
+    std::vector<size_t> load_arr_;
+    std::vector<Owner> owner_arr_;
+    std::mutex mutex_;
+    error_handler_t error_handler_;
+    Policy policy_;
+    size_t next_;
+
+    size_t pick(int fd);
+    bool in_thread(size_t index) const noexcept;
+    bool in_pool() const noexcept;
+    size_t detach(int fd, bool blocking, bool& moving);
+    void drop(size_t index, int fd, bool moving, task_t done);
+    void report(int fd, const IOHubExcept& e);
+    void unassign(int fd, size_t index, uint32_t gen);
+
+public:
+    ReactorPool(size_t loop_count, factory_t factory,
+        Policy policy = ROUND_ROBIN);
+    ~ReactorPool();
+
+    // uncopyable
+    ReactorPool(const ReactorPool&) = delete;
+    ReactorPool& operator=(const ReactorPool&) = delete;
+
+    // start the threads, loop i is pinned to cpu_arr[i] if given
+    void start(const std::vector<int>& cpu_arr = {});
+    void stop();
+
+    // returns the index of the loop the fd is assigned to
+    size_t add(int fd, int events, EventLoop::handler_t handler);
+    void modify(int fd, int events);
+    void remove(int fd);
+    void remove(int fd, task_t done);
+    void move(int fd, size_t index);
+
+    void set_error_handler(error_handler_t handler);
+    EventLoop& loop(size_t index);
+    size_t size() const noexcept;
+
+}; // class ReactorPool
+
+} // namespace iohub
+
+#if IOHUB_HEADER_ONLY
+#include "ReactorPool.cpp"
+#endif
+
+#endif // IOHUB_REACTOR_POOL_H
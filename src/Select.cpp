@@ -26,61 +26,103 @@
 
 #include "Select.h"
 
+// C++
+#include <algorithm>
+#include <new>
+
 namespace iohub {
 
-Select::Select() : fd_hasharr_(32), max_(-1), size_(0),
-        readsz_(0), writesz_(0), exceptsz_(0) {
-    // clear fd_set
-    FD_ZERO(&readfds_);
-    FD_ZERO(&writefds_);
-    FD_ZERO(&exceptfds_);
-    is_open_ = true;
+namespace {
+// kept in fd_hasharr_ next to the events, 0 events means disarmed
+const unsigned char SELECT_ONESHOT = 0x08;
+
+// the kernel reads fd sets as arrays of longs
+const int WORD_BITS = 8 * sizeof(unsigned long);
+
+inline fd_set* as_fd_set(std::vector<unsigned long>& words) {
+    return reinterpret_cast<fd_set*>(words.data());
 }
+} // anonymous namespace
 
-void Select::insert(int fd, int events) {
-    // exceptions
-    assert_throw_iohubexcept(is_open_, "[Select] insert(): Select is closed");
-    assert_throw_iohubexcept(fd >= 0,
-        "[Select] insert(): Invalid file descriptor");
-    assert_throw_iohubexcept(fd < __FD_SETSIZE, "[Select] insert(): "
-        "The fd set cannot be set to this file descriptor \'",
-        std::to_string(fd), '\'');
-    assert_throw_iohubexcept(events, "[Select] insert(): Events is empty. "
+IOHUB_INLINE
+Select::Select() : fd_hasharr_(32), ctx_arr_(32), max_(-1), size_(0),
+        readsz_(0), writesz_(0), exceptsz_(0),
+        readfds_(1), writefds_(1), exceptfds_(1), is_open_(true) {}
+
+IOHUB_INLINE
+void Select::set_events(int fd, int events, bool on) noexcept {
+    const size_t index = fd / WORD_BITS;
+    const word_t mask = word_t(1) << (fd % WORD_BITS);
+    const int delta = on ? 1 : -1;
+    if (events & IOHUB_IN) {
+        readfds_[index] = on ? readfds_[index] | mask : readfds_[index] & ~mask;
+        readsz_ += delta;
+    }
+    if (events & IOHUB_OUT) {
+        writefds_[index] = on ? writefds_[index] | mask : writefds_[index] & ~mask;
+        writesz_ += delta;
+    }
+    if (events & IOHUB_PRI) {
+        exceptfds_[index] = on ? exceptfds_[index] | mask : exceptfds_[index] & ~mask;
+        exceptsz_ += delta;
+    }
+}
+
+IOHUB_INLINE
+int Select::do_insert(int fd, int events, void* ctx) noexcept {
+    // errors
+    if (!is_open_) return this->fail(EBADF, "Select is closed");
+    if (fd < 0) return this->fail(EBADF, "Invalid file descriptor");
+    if (!(events & IOHUB_EVENT_MASK)) return this->fail(EINVAL,
+        "Events is empty. "
         "If you want to remove fd from select, use Select::erase()");
-    assert_throw_iohubexcept(!(events & ~0b111),
-        "[Select] insert(): Events is not supported. "
-        "Select supports only IOHUB_IN, IOHUB_OUT, IOHUB_PRI");
+    if (events & ~(IOHUB_EVENT_MASK | IOHUB_MODE_MASK)) return this->fail(
+        EINVAL, "Events is not supported. "
+        "Select supports only IOHUB_IN, IOHUB_OUT, IOHUB_PRI "
+        "and the trigger modes");
 
-    if (fd >= fd_hasharr_.size())
-        fd_hasharr_.resize(fd + 1);
+    try {
+        if (fd >= fd_hasharr_.size()) {
+            fd_hasharr_.resize(fd + 1);
+            ctx_arr_.resize(fd + 1);
+        }
+        if (fd / WORD_BITS >= readfds_.size()) {
+            readfds_.resize(fd / WORD_BITS + 1);
+            writefds_.resize(fd / WORD_BITS + 1);
+            exceptfds_.resize(fd / WORD_BITS + 1);
+        }
+    } catch (const std::bad_alloc&) {
+        return this->fail(ENOMEM);
+    }
 
-    assert_throw_iohubexcept(!fd_hasharr_[fd],
-        "[Select] insert(): The fd already exists. "
+    if (fd_hasharr_[fd]) return this->fail(EEXIST,
+        "The fd already exists. "
         "If you want to modify its event, use Select::modify()");
 
     // insert to the hash array
     if (size_++ == 0 || fd > max_) max_ = fd;
-    fd_hasharr_[fd] = static_cast<unsigned char>(events);
+    fd_hasharr_[fd] = static_cast<unsigned char>(events & IOHUB_EVENT_MASK)
+        | (events & IOHUB_ONESHOT ? SELECT_ONESHOT : 0);
+    ctx_arr_[fd] = ctx;
 
-    // set the fd_set
-    if (events & IOHUB_IN) { FD_SET(fd, &readfds_); ++readsz_; }
-    if (events & IOHUB_OUT) { FD_SET(fd, &writefds_); ++writesz_; }
-    if (events & IOHUB_PRI) { FD_SET(fd, &exceptfds_); ++exceptsz_; }
+    // set the fd sets
+    this->set_events(fd, events, true);
+    return 0;
 }
 
-void Select::erase(int fd) {
-    // exceptions
-    assert_throw_iohubexcept(is_open_, "[Select] erase(): Select is closed");
-    assert_throw_iohubexcept(fd >= 0, "[Select] erase(): Invalid fd");
-    assert_throw_iohubexcept(fd < fd_hasharr_.size() && fd_hasharr_[fd],
-        "[Select] erase():The fd does not exist");
+IOHUB_INLINE
+int Select::do_erase(int fd) noexcept {
+    // errors
+    if (!is_open_) return this->fail(EBADF, "Select is closed");
+    if (fd < 0) return this->fail(EBADF, "Invalid fd");
+    if (fd >= fd_hasharr_.size() || !fd_hasharr_[fd])
+        return this->fail(ENOENT, "The fd does not exist");
 
-    // reset the fd_set
+    // reset the fd sets
     unsigned char& old_events = fd_hasharr_[fd];
-    if (old_events & IOHUB_IN) { FD_CLR(fd, &readfds_); --readsz_; }
-    if (old_events & IOHUB_OUT) { FD_CLR(fd, &writefds_); --writesz_; }
-    if (old_events & IOHUB_PRI) { FD_CLR(fd, &exceptfds_); --exceptsz_; }
+    this->set_events(fd, old_events, false);
     old_events = 0;
+    ctx_arr_[fd] = nullptr;
 
     // remove from the hash array
     if (--size_) {
@@ -88,107 +130,131 @@ void Select::erase(int fd) {
     } else {
         max_ = -1;
     }
+    return 0;
+}
+
+IOHUB_INLINE
+int Select::do_modify(int fd, int events) noexcept {
+    // keep the context
+    bool exists = fd >= 0 && fd < fd_hasharr_.size() && fd_hasharr_[fd];
+    return this->do_modify(fd, events, exists ? ctx_arr_[fd] : nullptr);
 }
 
-void Select::modify(int fd, int events) {
-    // exceptions
-    assert_throw_iohubexcept(is_open_, "[Select] modify(): Select is closed");
-    assert_throw_iohubexcept(fd >= 0, "[Select] modify(): Invalid fd");
-    assert_throw_iohubexcept(fd < fd_hasharr_.size() && fd_hasharr_[fd],
-        "[Select] modify(): The fd does not exist");
-    assert_throw_iohubexcept(events, "[Select] modify(): Events is empty. "
+IOHUB_INLINE
+int Select::do_modify(int fd, int events, void* ctx) noexcept {
+    // errors
+    if (!is_open_) return this->fail(EBADF, "Select is closed");
+    if (fd < 0) return this->fail(EBADF, "Invalid fd");
+    if (fd >= fd_hasharr_.size() || !fd_hasharr_[fd])
+        return this->fail(ENOENT, "The fd does not exist");
+    if (!(events & IOHUB_EVENT_MASK)) return this->fail(EINVAL,
+        "Events is empty. "
         "If you want to remove fd from select, use Select::erase()");
-    assert_throw_iohubexcept(!(events & ~0b111),
-        "[Select] modify(): Events is not supported. "
-        "Select supports only IOHUB_IN, IOHUB_OUT, IOHUB_PRI");
+    if (events & ~(IOHUB_EVENT_MASK | IOHUB_MODE_MASK)) return this->fail(
+        EINVAL, "Events is not supported. "
+        "Select supports only IOHUB_IN, IOHUB_OUT, IOHUB_PRI "
+        "and the trigger modes");
 
-    // update the number of fds
+    // update the fd sets
     unsigned char& old_events = fd_hasharr_[fd];
-    int d_read = 0, d_write = 0, d_except = 0;
-    readsz_ += d_read =
-        ((int)!!(events & IOHUB_IN) - !!(old_events & IOHUB_IN));
-    writesz_ += d_write =
-        ((int)!!(events & IOHUB_OUT) - !!(old_events & IOHUB_OUT));
-    exceptsz_ += d_except =
-        ((int)!!(events & IOHUB_PRI) - !!(old_events & IOHUB_PRI));
-
-    // update the fd_set
-    if (d_read == 1) FD_SET(fd, &readfds_);
-    else if (d_read == -1) FD_CLR(fd, &readfds_);
-    if (d_write == 1) FD_SET(fd, &writefds_);
-    else if (d_write == -1) FD_CLR(fd, &writefds_);
-    if (d_except == 1) FD_SET(fd, &exceptfds_);
-    else if (d_except == -1) FD_CLR(fd, &exceptfds_);
+    this->set_events(fd, old_events & ~events, false);
+    this->set_events(fd, events & ~old_events, true);
 
     // update the hash array
-    old_events = events;
+    old_events = static_cast<unsigned char>(events & IOHUB_EVENT_MASK)
+        | (events & IOHUB_ONESHOT ? SELECT_ONESHOT : 0);
+    ctx_arr_[fd] = ctx;
+    return 0;
 }
 
-size_t Select::size() const noexcept {
+IOHUB_INLINE
+size_t Select::do_size() const noexcept {
     // return number of fds
     return size_;
 }
 
-void Select::clear() noexcept {
+IOHUB_INLINE
+void Select::do_clear() noexcept {
     if (is_open_) {
-        FD_ZERO(&readfds_);
-        FD_ZERO(&writefds_);
-        FD_ZERO(&exceptfds_);
+        std::fill(fd_hasharr_.begin(), fd_hasharr_.end(), 0);
+        std::fill(ctx_arr_.begin(), ctx_arr_.end(), nullptr);
+        std::fill(readfds_.begin(), readfds_.end(), 0);
+        std::fill(writefds_.begin(), writefds_.end(), 0);
+        std::fill(exceptfds_.begin(), exceptfds_.end(), 0);
         size_ = writesz_ = readsz_ = exceptsz_ = 0;
+        max_ = -1;
     }
 }
 
-size_t Select::wait(std::vector<fd_event_t>& fdevt_arr, int timeout) {
-    // exceptions
-    assert_throw_iohubexcept(is_open_, "[Select] wait(): Select is closed");
-    assert_throw_iohubexcept(size_ > 0, "[Select] wait(): Select is empty");
-
-    // set timeout
-    timeval time{};
-    timeval* ptime = nullptr;
-    if (timeout != -1) {
-        time.tv_sec = timeout / 1000;
-        time.tv_usec = timeout % 1000 * 1000;
-        ptime = &time;
-    }
+IOHUB_INLINE
+ssize_t Select::do_wait(visitor_t visitor, void* arg,
+        const timespec* timeout) {
+    // errors
+    if (!is_open_) return this->fail(EBADF, "Select is closed");
+    if (!size_) return this->fail(ENOENT, "Select is empty");
 
-    // copy fd_set
-    fd_set read, write, except;
+    // copy the used words of the fd sets
+    const size_t word_count = max_ / WORD_BITS + 1;
+    bool has_read = readsz_, has_write = writesz_, has_except = exceptsz_;
+    read_buf_.assign(readfds_.begin(), readfds_.begin() + word_count);
+    write_buf_.assign(writefds_.begin(), writefds_.begin() + word_count);
+    except_buf_.assign(exceptfds_.begin(), exceptfds_.begin() + word_count);
 
-    // call select()
-    int ret = ::select(max_ + 1,
-        readsz_ ? &(read = readfds_) : nullptr,
-        writesz_ ? &(write = writefds_) : nullptr,
-        exceptsz_ ? &(except = exceptfds_) : nullptr,
-        ptime);
+    // call pselect()
+    int ret = ::pselect(max_ + 1,
+        has_read ? as_fd_set(read_buf_) : nullptr,
+        has_write ? as_fd_set(write_buf_) : nullptr,
+        has_except ? as_fd_set(except_buf_) : nullptr,
+        timeout, nullptr);
 
-    if (ret == 0) {
-        // non-blocking
-        fdevt_arr.clear();
-        return 0;
-    }
-    assert_throw_iohubexcept(ret > 0, "[Select] wait(): ", LAST_ERROR);
+    // non-blocking or interrupted by a signal
+    if (ret == 0 || (ret == -1 && errno == EINTR)) return 0;
+    if (ret < 0) return this->fail(errno);
+
+    // or the sets together a word at a time, then visit the set bits
+    const word_t* read_words = read_buf_.data();
+    const word_t* write_words = write_buf_.data();
+    const word_t* except_words = except_buf_.data();
+
+    size_t result = 0;
+    for (size_t i = 0; i < word_count && result < ret; ++i) {
+        word_t ready = read_words[i] | write_words[i] | except_words[i];
+        while (ready) {
+            const int bit = __builtin_ctzl(ready);
+            const word_t mask = word_t(1) << bit;
+            const int fd = static_cast<int>(i * WORD_BITS + bit);
+            ready &= ready - 1;
 
-    // iterate over the result set
-    fdevt_arr.resize(ret);
-    for (size_t fd = 0, cnt = 0; cnt < ret; ++fd) {
-        if (fd_hasharr_[fd]) {
-            // ready
             int event = 0;
-            if (readsz_ && FD_ISSET(fd, &read)) event |= IOHUB_IN;
-            if (writesz_ && FD_ISSET(fd, &write)) event |= IOHUB_OUT;
-            if (exceptsz_ && FD_ISSET(fd, &except)) event |= IOHUB_PRI;
-            // push
-            if (event) fdevt_arr[cnt++] = {fd, event};
+            if (read_words[i] & mask) event |= IOHUB_IN;
+            if (write_words[i] & mask) event |= IOHUB_OUT;
+            if (except_words[i] & mask) event |= IOHUB_PRI;
+
+            // visit
+            ++result;
+            visitor(arg, fd, event, ctx_arr_[fd]);
+            if (fd_hasharr_[fd] & SELECT_ONESHOT) {
+                // one-shot: drop from the fd_sets until modify()
+                unsigned char& events = fd_hasharr_[fd];
+                this->set_events(fd, events, false);
+                events = SELECT_ONESHOT;
+            }
         }
     }
-    return ret;
+    return static_cast<ssize_t>(result);
+}
+
+IOHUB_INLINE
+const char* Select::name() const noexcept {
+    return "Select";
 }
 
+IOHUB_INLINE
 bool Select::is_open() const noexcept {
     return is_open_;
 }
 
+IOHUB_INLINE
 void Select::close() noexcept {
     if (is_open_) {
         this->clear();
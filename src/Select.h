@@ -42,31 +42,44 @@
 
 namespace iohub {
 
+// fd sets are heap bitmaps grown with the largest fd, so fds above
+// FD_SETSIZE work and only the used words are copied for each select().
 class Select : public PollerBase {
+    using word_t = unsigned long;
+
     std::vector<unsigned char> fd_hasharr_;
-    std::vector<fd_event_t> cache_;
+    std::vector<void*> ctx_arr_;
     size_t max_, size_, readsz_, writesz_, exceptsz_;
-    fd_set readfds_, writefds_, exceptfds_;
+    std::vector<word_t> readfds_, writefds_, exceptfds_;
+    std::vector<word_t> read_buf_, write_buf_, except_buf_;
     bool is_open_;
 
+    void set_events(int fd, int events, bool on) noexcept;
+
 public:
     Select();
     virtual ~Select() override = default;
 
-    virtual void insert(int fd, int events) override;
-    virtual void erase(int fd) override;
-    virtual void modify(int fd, int events) override;
-    virtual size_t size() const noexcept override;
-    virtual void clear() noexcept override;
-
-    virtual size_t wait(std::vector<fd_event_t>& fdevt_arr,
-        int timeout = -1) override;
-
+    virtual const char* name() const noexcept override;
     virtual bool is_open() const noexcept override;
     virtual void close() noexcept override;
 
+protected:
+    virtual int do_insert(int fd, int events, void* ctx) noexcept override;
+    virtual int do_erase(int fd) noexcept override;
+    virtual int do_modify(int fd, int events) noexcept override;
+    virtual int do_modify(int fd, int events, void* ctx) noexcept override;
+    virtual size_t do_size() const noexcept override;
+    virtual void do_clear() noexcept override;
+    virtual ssize_t do_wait(visitor_t visitor, void* arg,
+        const timespec* timeout) override;
+
 }; // class Select
 
 } // namespace iohub
 
+#if IOHUB_HEADER_ONLY
+#include "Select.cpp"
+#endif
+
 #endif // IOHUB_SELECT_H
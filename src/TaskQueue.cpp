@@ -0,0 +1,102 @@
+// File:     src/TaskQueue.cpp
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "TaskQueue.h"
+
+// C++
+#include <memory>
+
+namespace iohub {
+
+IOHUB_INLINE
+TaskQueue::TaskQueue() : back_(&stub_), front_(&stub_) {
+    stub_.next.store(nullptr, std::memory_order_relaxed);
+}
+
+IOHUB_INLINE
+TaskQueue::~TaskQueue() {
+    // drop the tasks that never ran
+    while (Node* node = this->pop()) delete node;
+}
+
+IOHUB_INLINE
+void TaskQueue::link(Node* node) noexcept {
+    node->next.store(nullptr, std::memory_order_relaxed);
+    Node* prev = back_.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+}
+
+IOHUB_INLINE
+TaskQueue::Node* TaskQueue::pop() noexcept {
+    Node* front = front_;
+    Node* next = front->next.load(std::memory_order_acquire);
+
+    // skip the stub
+    if (front == &stub_) {
+        if (!next) return nullptr;
+        front_ = front = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if (next) {
+        front_ = next;
+        return front;
+    }
+
+    // a producer swapped back_ but has not linked its node yet,
+    // its wake comes after the link
+    if (front != back_.load(std::memory_order_acquire)) return nullptr;
+
+    // front is the last node, put the stub behind it
+    this->link(&stub_);
+    next = front->next.load(std::memory_order_acquire);
+    if (next) {
+        front_ = next;
+        return front;
+    }
+    return nullptr;
+}
+
+IOHUB_INLINE
+void TaskQueue::push(task_t task) {
+    Node* node = new Node;
+    node->task = std::move(task);
+    this->link(node);
+}
+
+IOHUB_INLINE
+size_t TaskQueue::run() {
+    size_t count = 0;
+    while (Node* node = this->pop()) {
+        std::unique_ptr<Node> guard(node);
+        task_t task = std::move(node->task);
+        guard.reset();
+        task();
+        ++count;
+    }
+    return count;
+}
+
+} // namespace iohub
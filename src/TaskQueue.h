@@ -0,0 +1,83 @@
+// File:     src/TaskQueue.h
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef IOHUB_TASK_QUEUE_H
+#define IOHUB_TASK_QUEUE_H
+
+// C
+#include <cstddef>
+
+// C++
+#include <atomic>
+#include <functional>
+
+// iohub
+#include "except.h"
+
+namespace iohub {
+
+// Lock-free multi-producer single-consumer queue of tasks.
+// push() may be called from any thread, run() only from the consumer.
+class TaskQueue {
+public:
+    using task_t = std::function<void()>;
+
+private:
+    struct Node {
+        std::atomic<Node*> next;
+        task_t task;
+    }; // queue node
+
+    std::atomic<Node*> back_;   // last pushed, producers swap it
+    Node* front_;               // consumer side
+    Node stub_;
+
+    void link(Node* node) noexcept;
+    Node* pop() noexcept;
+
+public:
+    TaskQueue();
+    ~TaskQueue();
+
+    // uncopyable
+    TaskQueue(const TaskQueue&) = delete;
+    TaskQueue& operator=(const TaskQueue&) = delete;
+
+    void push(task_t task);
+
+    // run the queued tasks, returns how many ran
+    size_t run();
+
+}; // class TaskQueue
+
+} // namespace iohub
+
+#if IOHUB_HEADER_ONLY
+#include "TaskQueue.cpp"
+#endif
+
+#endif // IOHUB_TASK_QUEUE_H
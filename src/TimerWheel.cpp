@@ -0,0 +1,240 @@
+// File:     src/TimerWheel.cpp
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "TimerWheel.h"
+
+// C++
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+
+namespace iohub {
+
+namespace {
+const int TW_LEVELS = 5;
+const int TW_SLOT_BITS = 6;
+const int TW_SLOTS = 1 << TW_SLOT_BITS;
+const uint64_t TW_SLOT_MASK = TW_SLOTS - 1;
+const uint64_t TW_MAX_DELTA = (uint64_t(1) << (TW_LEVELS * TW_SLOT_BITS)) - 1;
+
+// list heads: one per slot, then the list being run
+const int TW_RUN = TW_LEVELS * TW_SLOTS;
+const uint32_t TW_HEADS = TW_RUN + 1;
+} // anonymous namespace
+
+IOHUB_INLINE
+TimerWheel::TimerWheel(uint64_t now) : node_arr_(TW_HEADS),
+        bitmap_arr_(TW_LEVELS), current_(now), size_(0) {
+    for (uint32_t i = 0; i < TW_HEADS; ++i)
+        node_arr_[i].prev = node_arr_[i].next = i;
+}
+
+IOHUB_INLINE
+void TimerWheel::link(uint32_t index, int slot) {
+    Node& node = node_arr_[index];
+    Node& head = node_arr_[slot];
+    node.prev = head.prev;
+    node.next = slot;
+    node_arr_[head.prev].next = index;
+    head.prev = index;
+    node.slot = slot;
+    if (slot < TW_RUN)
+        bitmap_arr_[slot / TW_SLOTS] |= uint64_t(1) << (slot % TW_SLOTS);
+}
+
+IOHUB_INLINE
+void TimerWheel::unlink(uint32_t index) {
+    Node& node = node_arr_[index];
+    node_arr_[node.prev].next = node.next;
+    node_arr_[node.next].prev = node.prev;
+    int slot = node.slot;
+    if (slot < TW_RUN && node_arr_[slot].next == slot)
+        bitmap_arr_[slot / TW_SLOTS] &= ~(uint64_t(1) << (slot % TW_SLOTS));
+    node.slot = -1;
+}
+
+IOHUB_INLINE
+void TimerWheel::splice(int from, int to) {
+    // move all the nodes of list `from` to the tail of list `to`
+    Node& src = node_arr_[from];
+    if (src.next == from) return;
+    for (uint32_t i = src.next; i != from; i = node_arr_[i].next)
+        node_arr_[i].slot = to;
+    Node& dst = node_arr_[to];
+    node_arr_[dst.prev].next = src.next;
+    node_arr_[src.next].prev = dst.prev;
+    node_arr_[src.prev].next = to;
+    dst.prev = src.prev;
+    src.prev = src.next = from;
+    if (from < TW_RUN)
+        bitmap_arr_[from / TW_SLOTS] &= ~(uint64_t(1) << (from % TW_SLOTS));
+}
+
+IOHUB_INLINE
+void TimerWheel::place(uint32_t index) {
+    // overdue timers run at the current tick, far ones are cascaded again
+    uint64_t expire = std::max(node_arr_[index].expire, current_);
+    uint64_t delta = expire - current_;
+    if (delta > TW_MAX_DELTA) {
+        delta = TW_MAX_DELTA;
+        expire = current_ + delta;
+    }
+    int level = 0;
+    while (delta >> ((level + 1) * TW_SLOT_BITS)) ++level;
+    int slot_index = (expire >> (level * TW_SLOT_BITS)) & TW_SLOT_MASK;
+    this->link(index, level * TW_SLOTS + slot_index);
+}
+
+IOHUB_INLINE
+void TimerWheel::release(uint32_t index) noexcept {
+    Node& node = node_arr_[index];
+    node.func = nullptr;
+    ++node.gen;
+    free_arr_.push_back(index);  // reserved by add()
+}
+
+IOHUB_INLINE
+timer_id_t TimerWheel::add(uint64_t expire, callback_t func) {
+    uint32_t index = 0;
+    if (free_arr_.empty()) {
+        index = static_cast<uint32_t>(node_arr_.size());
+        node_arr_.emplace_back();
+        free_arr_.reserve(node_arr_.size());
+    } else {
+        index = free_arr_.back();
+        free_arr_.pop_back();
+    }
+    Node& node = node_arr_[index];
+    node.expire = expire;
+    node.func = std::move(func);
+    this->place(index);
+    ++size_;
+    return static_cast<uint64_t>(node.gen) << 32 | index;
+}
+
+IOHUB_INLINE
+bool TimerWheel::cancel(timer_id_t id) noexcept {
+    uint32_t index = static_cast<uint32_t>(id & 0xffffffff);
+    uint32_t gen = static_cast<uint32_t>(id >> 32);
+    if (index < TW_HEADS || index >= node_arr_.size()) return false;
+    Node& node = node_arr_[index];
+    if (node.gen != gen || node.slot == -1) return false;
+    this->unlink(index);
+    this->release(index);
+    --size_;
+    return true;
+}
+
+IOHUB_INLINE
+int TimerWheel::next_timeout(uint64_t now) const noexcept {
+    if (!size_) return -1;
+
+    // timers waiting in the run list after an exception
+    uint64_t next = node_arr_[TW_RUN].next != TW_RUN ? current_ : UINT64_MAX;
+
+    // level 0 is exact to the tick
+    if (bitmap_arr_[0]) {
+        uint64_t ahead = bitmap_arr_[0] >> (current_ & TW_SLOT_MASK);
+        next = std::min(next, ahead ? current_ + __builtin_ctzll(ahead)
+            : (current_ | TW_SLOT_MASK) + 1 + __builtin_ctzll(bitmap_arr_[0]));
+    }
+
+    // the upper levels are due at their next cascade
+    for (int level = 1; level < TW_LEVELS; ++level) {
+        uint64_t bitmap = bitmap_arr_[level];
+        if (!bitmap) continue;
+        int shift = level * TW_SLOT_BITS;
+        int index = (current_ >> shift) & TW_SLOT_MASK;
+        // on a boundary not run yet, the current slot is still due
+        int first = current_ & ((uint64_t(1) << shift) - 1) ? index + 1 : index;
+        uint64_t ahead = first == TW_SLOTS ? 0 : bitmap >> first;
+        uint64_t distance = ahead ? first - index + __builtin_ctzll(ahead)
+            : TW_SLOTS - index + __builtin_ctzll(bitmap);
+        next = std::min(next, ((current_ >> shift) + distance) << shift);
+    }
+
+    if (next <= now) return 0;
+    return static_cast<int>(std::min<uint64_t>(next - now, INT_MAX));
+}
+
+IOHUB_INLINE
+size_t TimerWheel::advance(uint64_t now) {
+    size_t count = 0;
+    while (current_ <= now) {
+        if (!size_) {
+            current_ = now + 1;
+            break;
+        }
+
+        // cascade the upper levels at their boundaries
+        if (!(current_ & TW_SLOT_MASK)) {
+            for (int level = 1; level < TW_LEVELS; ++level) {
+                int index = (current_ >> (level * TW_SLOT_BITS)) & TW_SLOT_MASK;
+                this->splice(level * TW_SLOTS + index, TW_RUN);
+                while (node_arr_[TW_RUN].next != TW_RUN) {
+                    uint32_t i = node_arr_[TW_RUN].next;
+                    this->unlink(i);
+                    this->place(i);
+                }
+                if (index) break;
+            }
+        }
+
+        // run the current slot, callbacks may add or cancel timers
+        this->splice(current_ & TW_SLOT_MASK, TW_RUN);
+        ++current_;
+        while (node_arr_[TW_RUN].next != TW_RUN) {
+            uint32_t index = node_arr_[TW_RUN].next;
+            this->unlink(index);
+            callback_t func = std::move(node_arr_[index].func);
+            this->release(index);
+            --size_;
+            ++count;
+            func();
+        }
+
+        // skip the empty slots of level 0
+        if (current_ & TW_SLOT_MASK) {
+            uint64_t ahead = bitmap_arr_[0] >> (current_ & TW_SLOT_MASK);
+            uint64_t next = ahead ? current_ + __builtin_ctzll(ahead)
+                : (current_ | TW_SLOT_MASK) + 1;
+            current_ = std::min(next, now + 1);
+        }
+    }
+    return count;
+}
+
+IOHUB_INLINE
+size_t TimerWheel::size() const noexcept {
+    return size_;
+}
+
+IOHUB_INLINE
+bool TimerWheel::empty() const noexcept {
+    return !size_;
+}
+
+} // namespace iohub
@@ -0,0 +1,100 @@
+// File:     src/TimerWheel.h
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef IOHUB_TIMER_WHEEL_H
+#define IOHUB_TIMER_WHEEL_H
+
+// C
+#include <cstddef>
+#include <cstdint>
+
+// C++
+#include <functional>
+#include <vector>
+
+// iohub
+#include "except.h"
+
+namespace iohub {
+
+// 0 is never a valid timer id
+using timer_id_t = uint64_t;
+
+// Hierarchical timing wheel with 1 ms ticks: 5 levels of 64 slots,
+// nodes in one array linked by index. add() and cancel() are O(1),
+// later levels cascade down as the wheel turns.
+class TimerWheel {
+public:
+    using callback_t = std::function<void()>;
+
+private:
+    struct Node {
+        uint64_t expire = 0;
+        uint32_t prev = 0;
+        uint32_t next = 0;
+        uint32_t gen = 1;
+        int slot = -1;  // list the node is in, -1 if free
+        callback_t func;
+    }; // timer node, the first nodes are list heads
+
+    std::vector<Node> node_arr_;
+    std::vector<uint32_t> free_arr_;
+    std::vector<uint64_t> bitmap_arr_;  // non-empty slots of each level
+    uint64_t current_;  // next tick to run
+    size_t size_;
+
+    void link(uint32_t index, int slot);
+    void unlink(uint32_t index);
+    void splice(int from, int to);
+    void place(uint32_t index);
+    void release(uint32_t index) noexcept;
+
+public:
+    explicit TimerWheel(uint64_t now);
+
+    // call func at the tick `expire` (ms, same clock as now)
+    timer_id_t add(uint64_t expire, callback_t func);
+    bool cancel(timer_id_t id) noexcept;
+
+    // ms until the next timer (or cascade) is due, -1 if empty
+    int next_timeout(uint64_t now) const noexcept;
+
+    // run the timers due at or before now, returns the number run
+    size_t advance(uint64_t now);
+
+    size_t size() const noexcept;
+    bool empty() const noexcept;
+
+}; // class TimerWheel
+
+} // namespace iohub
+
+#if IOHUB_HEADER_ONLY
+#include "TimerWheel.cpp"
+#endif
+
+#endif // IOHUB_TIMER_WHEEL_H
@@ -0,0 +1,74 @@
+// File:     src/Waker.cpp
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "Waker.h"
+
+// C
+#include <cstdint>
+
+// Linux
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+namespace iohub {
+
+IOHUB_INLINE
+Waker::Waker() : fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+        pending_(false) {
+    // exceptions
+    assert_throw_iohubexcept(fd_ >= 0,
+        "[Waker] eventfd create failed, ", LAST_ERROR);
+}
+
+IOHUB_INLINE
+Waker::~Waker() {
+    ::close(fd_);
+}
+
+IOHUB_INLINE
+void Waker::wake() noexcept {
+    // already signaled and not yet reset
+    if (pending_.exchange(true, std::memory_order_acq_rel)) return;
+    uint64_t one = 1;
+    ssize_t ret = ::write(fd_, &one, sizeof(one));
+    (void)ret;
+}
+
+IOHUB_INLINE
+void Waker::reset() noexcept {
+    uint64_t count = 0;
+    ssize_t ret = ::read(fd_, &count, sizeof(count));
+    (void)ret;
+    // wakes after this write again
+    pending_.exchange(false, std::memory_order_acq_rel);
+}
+
+IOHUB_INLINE
+int Waker::fd() const noexcept {
+    return fd_;
+}
+
+} // namespace iohub
@@ -0,0 +1,69 @@
+// File:     src/Waker.h
+// Author:   AkashiNeko
+// Project:  iohub
+// Github:   https://github.com/AkashiNeko/iohub/
+
+/* Copyright AkashiNeko. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ *
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef IOHUB_WAKER_H
+#define IOHUB_WAKER_H
+
+// C++
+#include <atomic>
+
+// iohub
+#include "except.h"
+
+namespace iohub {
+
+// eventfd that wakes a thread blocked in a poller.
+// wake() is thread-safe and writes at most once until the next reset(),
+// so a burst of wakes costs one syscall.
+class Waker {
+    int fd_;
+    std::atomic<bool> pending_;
+
+public:
+    Waker();
+    ~Waker();
+
+    // uncopyable
+    Waker(const Waker&) = delete;
+    Waker& operator=(const Waker&) = delete;
+
+    void wake() noexcept;
+
+    // called by the woken thread before it handles the wake
+    void reset() noexcept;
+
+    int fd() const noexcept;
+
+}; // class Waker
+
+} // namespace iohub
+
+#if IOHUB_HEADER_ONLY
+#include "Waker.cpp"
+#endif
+
+#endif // IOHUB_WAKER_H
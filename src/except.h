@@ -85,6 +85,18 @@ inline void throw_except_(const Args&... args) {
 
 #define LAST_ERROR (std::strerror(errno))
 
+// IOHUB_HEADER_ONLY=1: each header includes its source, whose
+// definitions are marked inline by IOHUB_INLINE
+#ifndef IOHUB_HEADER_ONLY
+#define IOHUB_HEADER_ONLY 0
+#endif
+
+#if IOHUB_HEADER_ONLY
+#define IOHUB_INLINE inline
+#else
+#define IOHUB_INLINE
+#endif
+
 } // namespace iohub
 
 #endif // IOHUB_EXCEPT_H